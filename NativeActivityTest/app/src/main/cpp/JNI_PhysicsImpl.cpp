@@ -1,45 +1,105 @@
-#include "btBulletDynamicsCommon.h"
+#include "physics_api.h"
+#include "LinearMath/btAlignedObjectArray.h"
+#include "LinearMath/btMinMax.h"
 #include <jni.h>
+#include <cstdint>
 
 // try to replace with that, as those names are painful as fuck
 //#define PHYSICS_FUNC(f) Java_io_snower_game_client_BulletPhysicsNativeImpl_##
 
 extern "C" {
-JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_createWorld(JNIEnv * env, jobject obj);
+JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_createWorld(JNIEnv * env, jobject obj, jint threads, jint broadphase, jfloat minX, jfloat minY, jfloat minZ, jfloat maxX, jfloat maxY, jfloat maxZ, jfloat linearSleepThreshold, jfloat angularSleepThreshold, jfloat deactivationTime, jint solver, jint solverIterations, jboolean simdSolver, jfloat warmstartingFactor);
 JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_deleteWorld(JNIEnv * env, jobject obj, jlong handle);
-JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_createBodyInWorld(JNIEnv * env, jobject obj, jlong worldHandle, jint type, jfloat mass, jfloat x, jfloat y, jfloat z, jfloat sx, jfloat sy, jfloat sz);
+JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_createBodyInWorld(JNIEnv * env, jobject obj, jlong worldHandle, jint type, jfloat mass, jfloat x, jfloat y, jfloat z, jfloat sx, jfloat sy, jfloat sz, jint group, jint mask, jlong ownerHandle);
 JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_deleteBodyFromWorld(JNIEnv * env, jobject obj, jlong worldHandle, jlong bodyHandle);
-JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_simulate(JNIEnv * env, jobject obj, jlong worldHandle, jfloat step);
-JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyOpenGLMatrix(JNIEnv * env, jobject obj, jlong bodyHandle, jfloatArray dst);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_simulate(JNIEnv * env, jobject obj, jlong worldHandle, jfloat step);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyOpenGLMatrix(JNIEnv * env, jobject obj, jlong bodyHandle, jboolean interpolated, jfloatArray dst);
 JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyHandleData(JNIEnv * env, jobject obj, jlong bodyHandle, jfloatArray dst);
 JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_updateBodyWorldTransform(JNIEnv * env, jobject obj, jlong bodyHandle, jfloat x, jfloat y, jfloat z, jfloat q1, jfloat q2, jfloat q3, jfloat q4);
 JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_updateBodyVelocity(JNIEnv * env, jobject obj, jlong bodyHandle, jfloat lX, jfloat lY, jfloat lZ, jfloat aX, jfloat aY, jfloat aZ);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyIndex(JNIEnv * env, jobject obj, jlong bodyHandle);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_exportBodyStates(JNIEnv * env, jobject obj, jlong worldHandle, jboolean interpolated, jobject dst);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_applyCommands(JNIEnv * env, jobject obj, jlong worldHandle, jobject commands, jint length, jobject results);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_exportChangedBodyStates(JNIEnv * env, jobject obj, jlong worldHandle, jboolean interpolated, jobject dst, jobject changed);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getPoolStats(JNIEnv * env, jobject obj, jlong worldHandle, jintArray dst);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_resetWorld(JNIEnv * env, jobject obj, jlong worldHandle);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_prewarmWorlds(JNIEnv * env, jobject obj, jint count, jint bodies, jint threads);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_setStepping(JNIEnv * env, jobject obj, jlong worldHandle, jfloat fixedTimeStep, jint maxSubSteps);
+JNIEXPORT jfloat JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getInterpolationFraction(JNIEnv * env, jobject obj, jlong worldHandle);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_readContactEvents(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst);
+JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getDroppedContactEvents(JNIEnv * env, jobject obj, jlong worldHandle);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_setContactEvents(JNIEnv * env, jobject obj, jlong worldHandle, jboolean enabled);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_runSteppingBenchmark(JNIEnv * env, jobject obj, jintArray threadCounts, jint steps, jfloatArray results);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_castRays(JNIEnv * env, jobject obj, jlong worldHandle, jobject rays, jint count, jobject hits);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_queryRegion(JNIEnv * env, jobject obj, jlong worldHandle, jobject query, jobject dst);
+JNIEXPORT jfloat JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_runRaycastBenchmark(JNIEnv * env, jobject obj, jint rays, jint iterations);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_exportProjectiles(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_readProjectileHits(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst);
+JNIEXPORT jfloat JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_runProjectileBenchmark(JNIEnv * env, jobject obj, jint projectiles, jint steps);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_exportCharacterStates(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst);
+JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_createStaticBatch(JNIEnv * env, jobject obj, jlong worldHandle, jobject boxes, jint count, jint group, jint mask);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_runBroadphaseBenchmark(JNIEnv * env, jobject obj, jint steps, jfloatArray results);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_runSolverBenchmark(JNIEnv * env, jobject obj, jintArray solvers, jintArray iterations, jint steps, jfloatArray results);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_exportActivationStates(JNIEnv * env, jobject obj, jlong worldHandle, jintArray counts, jobject bits);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_snapshotWorld(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst, jboolean withContacts);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_restoreWorld(JNIEnv * env, jobject obj, jlong worldHandle, jobject src, jint length);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_setDeterministic(JNIEnv * env, jobject obj, jlong worldHandle, jboolean deterministic);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_stepTicks(JNIEnv * env, jobject obj, jlong worldHandle, jint ticks);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getTick(JNIEnv * env, jobject obj, jlong worldHandle);
+JNIEXPORT jlong JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_getStateHash(JNIEnv * env, jobject obj, jlong worldHandle, jint tick);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_saveCheckpoint(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_loadCheckpoint(JNIEnv * env, jobject obj, jlong worldHandle, jobject src, jint length, jobject handles);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_readStepStats(JNIEnv * env, jobject obj, jlong worldHandle, jfloatArray dst);
+JNIEXPORT jboolean JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_startStepThread(JNIEnv * env, jobject obj, jlong worldHandle);
+JNIEXPORT void JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_stopStepThread(JNIEnv * env, jobject obj, jlong worldHandle);
+JNIEXPORT jboolean JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_submitCommands(JNIEnv * env, jobject obj, jlong worldHandle, jobject commands, jint length);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_readCommandResults(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst);
+JNIEXPORT jint JNICALL Java_io_snower_game_client_BulletPhysicsNativeImpl_readFrame(JNIEnv * env, jobject obj, jlong worldHandle, jobject info, jobject bodyStates, jobject projectiles, jobject characters);
 };
 
+// JNI bindings of the physics core for BulletPhysicsNativeImpl: thin wrappers over the C API
+// (physics_api.h), turning handles into pointers and direct buffers into records. World and body
+// handles are the PhysicsWorld and PhysicsBody pointers. Capacities of direct buffers are passed
+// on in records, so the core never writes past them.
+
+static PhysicsWorld* asWorld(jlong handle) {
+    return (PhysicsWorld*)(intptr_t) handle;
+}
+
+static PhysicsBody* asBody(jlong handle) {
+    return (PhysicsBody*)(intptr_t) handle;
+}
+
+static jlong asHandle(const void* pointer) {
+    return (jlong)(intptr_t) pointer;
+}
+
+// Whole records of the given size that fit in a direct buffer.
+static int directCapacity(JNIEnv* env, jobject buffer, size_t recordSize) {
+    return (int) btMin(env->GetDirectBufferCapacity(buffer) / (jlong) recordSize, (jlong) 0x7fffffff);
+}
+
 JNIEXPORT jlong JNICALL
 Java_io_snower_game_client_BulletPhysicsNativeImpl_createWorld
-(JNIEnv * env, jobject obj) {
-    auto* broadphase = new btDbvtBroadphase();
-    auto* configuration = new btDefaultCollisionConfiguration();
-    auto* dispatcher = new btCollisionDispatcher(configuration);
-    auto* solver = new btSequentialImpulseConstraintSolver();
-    auto* world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, configuration);
-    world->setGravity(btVector3(0.0f, -10.0f, 0.0f));
-    return (jlong)world;
+(JNIEnv * env, jobject obj, jint threads, jint broadphase,
+        jfloat minX, jfloat minY, jfloat minZ,
+        jfloat maxX, jfloat maxY, jfloat maxZ,
+        jfloat linearSleepThreshold, jfloat angularSleepThreshold, jfloat deactivationTime,
+        jint solver, jint solverIterations, jboolean simdSolver, jfloat warmstartingFactor) {
+    PhysicsWorldConfig config = {
+        threads, broadphase,
+        { minX, minY, minZ }, { maxX, maxY, maxZ },
+        linearSleepThreshold, angularSleepThreshold, deactivationTime,
+        solver, solverIterations, simdSolver, warmstartingFactor
+    };
+    return asHandle(physics_create_world(&config));
 }
 
+// Deleted worlds are reset and go back to the world pool if there's room for them.
 JNIEXPORT void JNICALL
 Java_io_snower_game_client_BulletPhysicsNativeImpl_deleteWorld
 (JNIEnv * env, jobject obj, jlong handle) {
-    auto* world = (btDiscreteDynamicsWorld*) handle;
-    auto* broadphase = world->getBroadphase();
-    // TODO: delete configuration too. this leaks (although is tiny, on gamemode changes)
-    auto* solver = world->getConstraintSolver();
-    auto* dispatcher = world->getDispatcher();
-    delete world;
-    delete broadphase;
-    delete solver;
-    delete dispatcher;
+    physics_delete_world(asWorld(handle));
 }
 
 JNIEXPORT jlong JNICALL
@@ -47,112 +107,39 @@ Java_io_snower_game_client_BulletPhysicsNativeImpl_createBodyInWorld
 (JNIEnv * env, jobject obj, jlong worldHandle,
         jint type, jfloat mass,
         jfloat x, jfloat y, jfloat z,
-        jfloat sx, jfloat sy, jfloat sz) {
-
-    int TYPE_BOX = 0;
-    int TYPE_CHARACTER = 1;
-    int TYPE_BULLET = 2;
-
-    // create shape and calculate inertia
-    btVector3 pos(x, y, z);
-    btCollisionShape* shape = nullptr;
-    if (type == TYPE_BULLET) {
-        shape = new btSphereShape(sx);
-    } else {
-        btVector3 halfExtents(sx, sy, sz);
-        halfExtents /= btScalar(2.0f);
-        shape = new btBoxShape(halfExtents);
-    }
-
-    // calculate inertia, only for non-static objects
-    btVector3 inertia;
-    if (mass != 0.0f) {
-        shape->calculateLocalInertia(mass, inertia);
-    }
-
-    // create world transform
-    btTransform transform;
-    transform.setIdentity();
-    transform.setOrigin(pos);
-
-    // create body, with their motionState and so
-    auto* motionState = new btDefaultMotionState(transform);
-    btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, shape, inertia);
-    auto* body = new btRigidBody(rbInfo);
-
-    // set ccd for bullets
-    if (type == TYPE_BULLET) {
-        body->setCcdMotionThreshold(0.2f);
-    }
-
-    // set friction for static objects
-    if (type == TYPE_BOX && mass == 0.0f) {
-        //body->setFriction(0.95f);
-    }
-
-    // add to world
-    auto* world = (btDiscreteDynamicsWorld*) worldHandle;
-    world->addRigidBody(body);
-
-    return (jlong)body;
+        jfloat sx, jfloat sy, jfloat sz,
+        jint group, jint mask, jlong ownerHandle) {
+    const float position[3] = { x, y, z };
+    const float size[3] = { sx, sy, sz };
+    return asHandle(physics_create_body(asWorld(worldHandle), type, mass, position, size, group, mask, asBody(ownerHandle)));
 }
 
 JNIEXPORT void JNICALL
 Java_io_snower_game_client_BulletPhysicsNativeImpl_deleteBodyFromWorld
 (JNIEnv * env, jobject obj, jlong worldHandle, jlong bodyHandle) {
-    auto* world = (btDiscreteDynamicsWorld*) worldHandle;
-    auto* body = (btRigidBody*) bodyHandle;
-    world->removeRigidBody(body);
-    delete body;
+    physics_delete_body(asWorld(worldHandle), asBody(bodyHandle));
 }
 
-JNIEXPORT void JNICALL
+// Returns how many fixed substeps were simulated.
+JNIEXPORT jint JNICALL
 Java_io_snower_game_client_BulletPhysicsNativeImpl_simulate
 (JNIEnv * env, jobject obj, jlong worldHandle, jfloat step) {
-    auto* world = (btDiscreteDynamicsWorld*) worldHandle;
-    world->stepSimulation(step);
+    return physics_simulate(asWorld(worldHandle), step);
 }
 
 JNIEXPORT void JNICALL
 Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyOpenGLMatrix
-(JNIEnv * env, jobject obj, jlong bodyHandle, jfloatArray dst) {
-    auto* body = (btRigidBody*) bodyHandle;
+(JNIEnv * env, jobject obj, jlong bodyHandle, jboolean interpolated, jfloatArray dst) {
     auto* array = (jfloat*)env->GetPrimitiveArrayCritical(dst, NULL);
-    body->getWorldTransform().getOpenGLMatrix(array);
+    physics_get_body_opengl_matrix(asBody(bodyHandle), interpolated, array);
     env->ReleasePrimitiveArrayCritical(dst, array, 0);
 }
 
 JNIEXPORT void JNICALL
 Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyHandleData
 (JNIEnv * env, jobject obj, jlong bodyHandle, jfloatArray dst) {
-    // get array
-    auto* body = (btRigidBody*) bodyHandle;
     auto* array = (jfloat*)env->GetPrimitiveArrayCritical(dst, NULL);
-
-    // copy bullet data to the array
-    btTransform t = body->getWorldTransform();
-    btVector3 origin = t.getOrigin();
-    array[0] = origin.getX();
-    array[1] = origin.getY();
-    array[2] = origin.getZ();
-
-    btQuaternion quaterion = t.getRotation();
-    array[3] = quaterion.getX();
-    array[4] = quaterion.getY();
-    array[5] = quaterion.getZ();
-    array[6] = quaterion.getW();
-
-    btVector3 linearVelocity = body->getLinearVelocity();
-    array[7] = linearVelocity.getX();
-    array[8] = linearVelocity.getY();
-    array[9] = linearVelocity.getZ();
-
-    btVector3 angularVelocity = body->getAngularVelocity();
-    array[10] = angularVelocity.getX();
-    array[11] = angularVelocity.getY();
-    array[12] = angularVelocity.getZ();
-
-    // release
+    physics_get_body_state(asBody(bodyHandle), array);
     env->ReleasePrimitiveArrayCritical(dst, array, 0);
 }
 
@@ -161,9 +148,9 @@ Java_io_snower_game_client_BulletPhysicsNativeImpl_updateBodyWorldTransform
 (JNIEnv * env, jobject obj, jlong bodyHandle,
         jfloat x, jfloat y, jfloat z,
         jfloat q1, jfloat q2, jfloat q3, jfloat q4) {
-    auto* body = (btRigidBody*) bodyHandle;
-    body->getWorldTransform().setOrigin(btVector3(x, y, z));
-    body->getWorldTransform().setRotation(btQuaternion(q1, q2, q3, q4));
+    const float position[3] = { x, y, z };
+    const float rotation[4] = { q1, q2, q3, q4 };
+    physics_set_body_transform(asBody(bodyHandle), position, rotation);
 }
 
 JNIEXPORT void JNICALL
@@ -171,12 +158,311 @@ Java_io_snower_game_client_BulletPhysicsNativeImpl_updateBodyVelocity
 (JNIEnv * env, jobject obj, jlong bodyHandle,
         jfloat lX, jfloat lY, jfloat lZ,
         jfloat aX, jfloat aY, jfloat aZ) {
-    auto* body = (btRigidBody*) bodyHandle;
-    btVector3 linearVelocity(lX, lY, lZ);
-    btVector3 angularVelocity(aX, aY, aZ);
-    if (!linearVelocity.fuzzyZero() || !angularVelocity.fuzzyZero()) {
-        body->activate();
-    }
-    body->setLinearVelocity(btVector3(lX, lY, lZ));
-    body->setAngularVelocity(btVector3(aX, aY, aZ));
-}
\ No newline at end of file
+    const float linearVelocity[3] = { lX, lY, lZ };
+    const float angularVelocity[3] = { aX, aY, aZ };
+    physics_set_body_velocity(asBody(bodyHandle), linearVelocity, angularVelocity);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_getBodyIndex
+(JNIEnv * env, jobject obj, jlong bodyHandle) {
+    return physics_get_body_index(asBody(bodyHandle));
+}
+
+// dst is laid out as in PhysicsWorld::exportBodyStates, with capacity = bytes / (PHYSICS_BODY_STATE_FLOATS * 4) slots.
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_exportBodyStates
+(JNIEnv * env, jobject obj, jlong worldHandle, jboolean interpolated, jobject dst) {
+    return physics_export_body_states(asWorld(worldHandle), interpolated, (float*) env->GetDirectBufferAddress(dst),
+                                      directCapacity(env, dst, PHYSICS_BODY_STATE_FLOATS * sizeof(float)));
+}
+
+// Applies the first length bytes of the commands direct buffer. results gets two jlongs per result.
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_applyCommands
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject commands, jint length, jobject results) {
+    return physics_apply_commands(asWorld(worldHandle), (const int32_t*) env->GetDirectBufferAddress(commands),
+                                  length / (int) sizeof(int32_t), (int64_t*) env->GetDirectBufferAddress(results),
+                                  directCapacity(env, results, 2 * sizeof(int64_t)));
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_exportChangedBodyStates
+(JNIEnv * env, jobject obj, jlong worldHandle, jboolean interpolated, jobject dst, jobject changed) {
+    return physics_export_changed_body_states(asWorld(worldHandle), interpolated,
+                                              (float*) env->GetDirectBufferAddress(dst),
+                                              directCapacity(env, dst, PHYSICS_BODY_STATE_FLOATS * sizeof(float)),
+                                              (int32_t*) env->GetDirectBufferAddress(changed),
+                                              directCapacity(env, changed, sizeof(int32_t)));
+}
+
+// dst must hold 2 * PHYSICS_POOL_COUNT ints.
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_getPoolStats
+(JNIEnv * env, jobject obj, jlong worldHandle, jintArray dst) {
+    int32_t stats[PHYSICS_POOL_COUNT * 2];
+    physics_get_pool_stats(asWorld(worldHandle), stats);
+    env->SetIntArrayRegion(dst, 0, PHYSICS_POOL_COUNT * 2, (const jint*) stats);
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_resetWorld
+(JNIEnv * env, jobject obj, jlong worldHandle) {
+    physics_reset_world(asWorld(worldHandle));
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_prewarmWorlds
+(JNIEnv * env, jobject obj, jint count, jint bodies, jint threads) {
+    physics_prewarm_worlds(count, bodies, threads);
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_setStepping
+(JNIEnv * env, jobject obj, jlong worldHandle, jfloat fixedTimeStep, jint maxSubSteps) {
+    physics_set_stepping(asWorld(worldHandle), fixedTimeStep, maxSubSteps);
+}
+
+JNIEXPORT jfloat JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_getInterpolationFraction
+(JNIEnv * env, jobject obj, jlong worldHandle) {
+    return physics_get_interpolation_fraction(asWorld(worldHandle));
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_setDeterministic
+(JNIEnv * env, jobject obj, jlong worldHandle, jboolean deterministic) {
+    physics_set_deterministic(asWorld(worldHandle), deterministic);
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_stepTicks
+(JNIEnv * env, jobject obj, jlong worldHandle, jint ticks) {
+    physics_step_ticks(asWorld(worldHandle), ticks);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_getTick
+(JNIEnv * env, jobject obj, jlong worldHandle) {
+    return physics_get_tick(asWorld(worldHandle));
+}
+
+JNIEXPORT jlong JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_getStateHash
+(JNIEnv * env, jobject obj, jlong worldHandle, jint tick) {
+    return physics_get_state_hash(asWorld(worldHandle), tick);
+}
+
+// dst must hold PHYSICS_STATS_FLOATS floats.
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_readStepStats
+(JNIEnv * env, jobject obj, jlong worldHandle, jfloatArray dst) {
+    float stats[PHYSICS_STATS_FLOATS];
+    physics_read_step_stats(asWorld(worldHandle), stats);
+    env->SetFloatArrayRegion(dst, 0, PHYSICS_STATS_FLOATS, stats);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_readContactEvents
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst) {
+    return physics_read_contact_events(asWorld(worldHandle), (PhysicsContactEvent*) env->GetDirectBufferAddress(dst),
+                                       directCapacity(env, dst, sizeof(PhysicsContactEvent)));
+}
+
+JNIEXPORT jlong JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_getDroppedContactEvents
+(JNIEnv * env, jobject obj, jlong worldHandle) {
+    return physics_get_dropped_contact_events(asWorld(worldHandle));
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_setContactEvents
+(JNIEnv * env, jobject obj, jlong worldHandle, jboolean enabled) {
+    physics_set_contact_events(asWorld(worldHandle), enabled);
+}
+
+// Casts up to count rays, as many as both direct buffers hold.
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_castRays
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject rays, jint count, jobject hits) {
+    count = btMin((int) count, directCapacity(env, rays, sizeof(PhysicsRayQuery)));
+    count = btMin((int) count, directCapacity(env, hits, sizeof(PhysicsRayHit)));
+    return physics_cast_rays(asWorld(worldHandle), (const PhysicsRayQuery*) env->GetDirectBufferAddress(rays),
+                             (PhysicsRayHit*) env->GetDirectBufferAddress(hits), count);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_queryRegion
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject query, jobject dst) {
+    if (directCapacity(env, query, sizeof(PhysicsRegionQuery)) < 1) return 0;
+    return physics_query_region(asWorld(worldHandle), (const PhysicsRegionQuery*) env->GetDirectBufferAddress(query),
+                                (int32_t*) env->GetDirectBufferAddress(dst), directCapacity(env, dst, sizeof(int32_t)));
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_runSteppingBenchmark
+(JNIEnv * env, jobject obj, jintArray threadCounts, jint steps, jfloatArray results) {
+    jsize count = env->GetArrayLength(threadCounts);
+    if (count == 0) return;
+    btAlignedObjectArray<int32_t> threads;
+    btAlignedObjectArray<float> millis;
+    threads.resize(count);
+    millis.resize(count);
+    env->GetIntArrayRegion(threadCounts, 0, count, (jint*) &threads[0]);
+    physics_run_stepping_benchmark(&threads[0], count, steps, &millis[0]);
+    env->SetFloatArrayRegion(results, 0, count, &millis[0]);
+}
+
+JNIEXPORT jfloat JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_runRaycastBenchmark
+(JNIEnv * env, jobject obj, jint rays, jint iterations) {
+    return physics_run_raycast_benchmark(rays, iterations);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_exportProjectiles
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst) {
+    return physics_export_projectiles(asWorld(worldHandle), (PhysicsProjectileState*) env->GetDirectBufferAddress(dst),
+                                      directCapacity(env, dst, sizeof(PhysicsProjectileState)));
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_readProjectileHits
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst) {
+    return physics_read_projectile_hits(asWorld(worldHandle), (PhysicsProjectileHit*) env->GetDirectBufferAddress(dst),
+                                        directCapacity(env, dst, sizeof(PhysicsProjectileHit)));
+}
+
+JNIEXPORT jfloat JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_runProjectileBenchmark
+(JNIEnv * env, jobject obj, jint projectiles, jint steps) {
+    return physics_run_projectile_benchmark(projectiles, steps);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_exportCharacterStates
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst) {
+    return physics_export_character_states(asWorld(worldHandle), (PhysicsCharacterState*) env->GetDirectBufferAddress(dst),
+                                           directCapacity(env, dst, sizeof(PhysicsCharacterState)));
+}
+
+// Merges up to count PhysicsStaticBox records of the boxes direct buffer. Returns the body handle,
+// to remove boxes later with CMD_REMOVE_BATCH_CHILD and their position in boxes as child id.
+JNIEXPORT jlong JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_createStaticBatch
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject boxes, jint count, jint group, jint mask) {
+    count = btMin((int) count, directCapacity(env, boxes, sizeof(PhysicsStaticBox)));
+    return asHandle(physics_create_static_batch(asWorld(worldHandle), (const PhysicsStaticBox*) env->GetDirectBufferAddress(boxes),
+                                                count, group, mask));
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_runBroadphaseBenchmark
+(JNIEnv * env, jobject obj, jint steps, jfloatArray results) {
+    if (steps <= 0) return;
+    float values[PHYSICS_BROADPHASE_BENCHMARK_FLOATS];
+    physics_run_broadphase_benchmark(steps, values);
+    env->SetFloatArrayRegion(results, 0, PHYSICS_BROADPHASE_BENCHMARK_FLOATS, values);
+}
+
+// Benchmarks as many solver configurations as both arrays hold, results must hold
+// PHYSICS_SOLVER_BENCHMARK_FLOATS for each.
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_runSolverBenchmark
+(JNIEnv * env, jobject obj, jintArray solvers, jintArray iterations, jint steps, jfloatArray results) {
+    jsize count = btMin(env->GetArrayLength(solvers), env->GetArrayLength(iterations));
+    if (count == 0 || steps <= 0) return;
+    btAlignedObjectArray<int32_t> kinds;
+    btAlignedObjectArray<int32_t> counts;
+    btAlignedObjectArray<float> values;
+    kinds.resize(count);
+    counts.resize(count);
+    values.resize(count * PHYSICS_SOLVER_BENCHMARK_FLOATS);
+    env->GetIntArrayRegion(solvers, 0, count, (jint*) &kinds[0]);
+    env->GetIntArrayRegion(iterations, 0, count, (jint*) &counts[0]);
+    physics_run_solver_benchmark(&kinds[0], &counts[0], count, steps, &values[0]);
+    env->SetFloatArrayRegion(results, 0, values.size(), &values[0]);
+}
+
+// counts must hold PHYSICS_ACTIVATION_STATE_COUNT ints.
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_exportActivationStates
+(JNIEnv * env, jobject obj, jlong worldHandle, jintArray counts, jobject bits) {
+    int32_t stateCounts[PHYSICS_ACTIVATION_STATE_COUNT];
+    int slots = physics_export_activation_states(asWorld(worldHandle), stateCounts, (int32_t*) env->GetDirectBufferAddress(bits),
+                                                 directCapacity(env, bits, sizeof(int32_t)));
+    env->SetIntArrayRegion(counts, 0, PHYSICS_ACTIVATION_STATE_COUNT, (const jint*) stateCounts);
+    return slots;
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_snapshotWorld
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst, jboolean withContacts) {
+    return physics_snapshot_world(asWorld(worldHandle), env->GetDirectBufferAddress(dst), env->GetDirectBufferCapacity(dst), withContacts);
+}
+
+// Rewinds to the snapshot in the first length bytes of src.
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_restoreWorld
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject src, jint length) {
+    return physics_restore_world(asWorld(worldHandle), env->GetDirectBufferAddress(src), length);
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_saveCheckpoint
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst) {
+    return physics_save_checkpoint(asWorld(worldHandle), env->GetDirectBufferAddress(dst), env->GetDirectBufferCapacity(dst));
+}
+
+// Loads the checkpoint in the first length bytes of src, writing the handle of the body at each
+// index into handles (jlongs, 0 for free slots).
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_loadCheckpoint
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject src, jint length, jobject handles) {
+    PhysicsWorld* world = asWorld(worldHandle);
+    int slots = physics_load_checkpoint(world, env->GetDirectBufferAddress(src), length, directCapacity(env, handles, sizeof(jlong)));
+    auto* out = (jlong*) env->GetDirectBufferAddress(handles);
+    for (int i = 0; i < slots; i++) out[i] = asHandle(physics_get_body(world, i));
+    return slots;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_startStepThread
+(JNIEnv * env, jobject obj, jlong worldHandle) {
+    return (jboolean) physics_start_step_thread(asWorld(worldHandle));
+}
+
+JNIEXPORT void JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_stopStepThread
+(JNIEnv * env, jobject obj, jlong worldHandle) {
+    physics_stop_step_thread(asWorld(worldHandle));
+}
+
+// Queues the first length bytes of the commands direct buffer for the step thread.
+JNIEXPORT jboolean JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_submitCommands
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject commands, jint length) {
+    return (jboolean) physics_submit_commands(asWorld(worldHandle), (const int32_t*) env->GetDirectBufferAddress(commands),
+                                              length / (int) sizeof(int32_t));
+}
+
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_readCommandResults
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject dst) {
+    return physics_read_command_results(asWorld(worldHandle), (int64_t*) env->GetDirectBufferAddress(dst),
+                                        directCapacity(env, dst, 2 * sizeof(int64_t)));
+}
+
+// info is a PhysicsFrameInfo, bodyStates as in exportBodyStates. -1 without reading if info can't hold one.
+JNIEXPORT jint JNICALL
+Java_io_snower_game_client_BulletPhysicsNativeImpl_readFrame
+(JNIEnv * env, jobject obj, jlong worldHandle, jobject info, jobject bodyStates, jobject projectiles, jobject characters) {
+    if (directCapacity(env, info, sizeof(PhysicsFrameInfo)) < 1) return -1;
+    return physics_read_frame(asWorld(worldHandle), (PhysicsFrameInfo*) env->GetDirectBufferAddress(info),
+                              (float*) env->GetDirectBufferAddress(bodyStates),
+                              directCapacity(env, bodyStates, PHYSICS_BODY_STATE_FLOATS * sizeof(float)),
+                              (PhysicsProjectileState*) env->GetDirectBufferAddress(projectiles),
+                              directCapacity(env, projectiles, sizeof(PhysicsProjectileState)),
+                              (PhysicsCharacterState*) env->GetDirectBufferAddress(characters),
+                              directCapacity(env, characters, sizeof(PhysicsCharacterState)));
+}
@@ -0,0 +1,2685 @@
+#include "PhysicsWorld.h"
+#include "physics_scenes.h"
+#include "btBulletDynamicsCommon.h"
+#include "LinearMath/btHashMap.h"
+#include "LinearMath/btThreads.h"
+#include "LinearMath/btSerializer.h"
+#include "LinearMath/btQuickprof.h"
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
+#include "BulletDynamics/ConstraintSolver/btNNCGConstraintSolver.h"
+#include "BulletDynamics/MLCPSolvers/btMLCPSolver.h"
+#include "BulletDynamics/MLCPSolvers/btDantzigSolver.h"
+#include "BulletDynamics/MLCPSolvers/btLemkeSolver.h"
+#include "BulletDynamics/MLCPSolvers/btSolveProjectedGaussSeidel.h"
+#include "BulletCollision/CollisionDispatch/btGhostObject.h"
+#include "BulletDynamics/Character/btKinematicCharacterController.h"
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
+#include <atomic>
+#include <cfenv>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <utility>
+
+#define  LOG_TAG    "snower-jni"
+#ifdef __ANDROID__
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGW(...)  __android_log_print(ANDROID_LOG_WARN,LOG_TAG,__VA_ARGS__)
+#else // desktop builds, see physics_bench.cpp
+#define  LOGI(...)  (fprintf(stderr, LOG_TAG ": " __VA_ARGS__), fputc('\n', stderr))
+#define  LOGW(...)  LOGI(__VA_ARGS__)
+#endif
+
+// Pool of same-typed objects, carved out of slabs of SLAB_SIZE objects. Slabs go back
+// to the heap only when the pool is deleted, so after warming up create and destroy are
+// O(1) free list operations that never touch the heap. Live objects must be destroyed
+// before the pool is.
+template <typename T, int SLAB_SIZE = 64>
+class ObjectPool {
+public:
+    ObjectPool() : live(0) {}
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool() {
+        for (int i = 0; i < slabs.size(); i++) {
+            btAlignedFree(slabs[i]);
+        }
+    }
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        if (freeList.size() == 0) grow();
+        void* memory = freeList[freeList.size() - 1];
+        freeList.pop_back();
+        live++;
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        freeList.push_back(object);
+        live--;
+    }
+
+    // Makes sure at least count objects can be created without growing.
+    void reserve(int count) {
+        while (freeList.size() < count) grow();
+    }
+
+    int liveCount() const { return live; }
+    int pooledCount() const { return freeList.size(); }
+
+private:
+    void grow() {
+        auto* slab = (char*) btAlignedAlloc(sizeof(T) * SLAB_SIZE, 16);
+        slabs.push_back(slab);
+        for (int i = SLAB_SIZE - 1; i >= 0; i--) {
+            freeList.push_back(slab + i * sizeof(T));
+        }
+    }
+
+    btAlignedObjectArray<void*> slabs;
+    btAlignedObjectArray<void*> freeList;
+    int live;
+};
+
+// Broadphase filter: pairs are created only if each body group is in the other body mask,
+// and neither body is the owner of the other (i.e. balls don't hit the player who fired them).
+// The owner is kept as its serial in the owned body user index 3 (-1 if none).
+struct BodyOverlapFilter : public btOverlapFilterCallback {
+    bool needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const override {
+        if ((proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) == 0) return false;
+        if ((proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask) == 0) return false;
+        auto* a = (const btCollisionObject*) proxy0->m_clientObject;
+        auto* b = (const btCollisionObject*) proxy1->m_clientObject;
+        if (a->getUserIndex3() >= 0 && a->getUserIndex3() == b->getUserIndex2()) return false;
+        if (b->getUserIndex3() >= 0 && b->getUserIndex3() == a->getUserIndex2()) return false;
+        return true;
+    }
+};
+
+// Identifies a collision shape by kind and size, so bodies with equal shapes can share one.
+struct ShapeKey {
+    bool sphere;
+    btScalar x, y, z; // full extents for boxes, radius on x for spheres
+
+    unsigned int getHash() const {
+        unsigned int hash = sphere ? 1u : 0u;
+        const btScalar values[] = { x, y, z };
+        for (btScalar value : values) {
+            unsigned int bits;
+            memcpy(&bits, &value, sizeof(bits));
+            hash = hash * 31u + bits;
+        }
+        return hash;
+    }
+
+    bool equals(const ShapeKey& other) const {
+        return sphere == other.sphere && x == other.x && y == other.y && z == other.z;
+    }
+};
+
+// A shape shared by refs bodies. Stored as the shape user pointer.
+struct SharedShape {
+    ShapeKey key;
+    btCollisionShape* shape;
+    int refs;
+};
+
+class TrackingMotionState;
+struct Character;
+
+// Static boxes merged into a single body (see createStaticBatch): a compound shape with a
+// dynamic aabb tree over its box children, so a whole level is one broadphase proxy however
+// many boxes it has. Stored as the compound shape user pointer.
+struct StaticBatch {
+    btCompoundShape shape;
+    btAlignedObjectArray<int> childIds; // id of each child, by child index
+};
+
+// Contact events kept until read. Older ones are dropped when it's full. Power of two.
+static const int CONTACT_RING_CAPACITY = 4096;
+
+// Identifies a pair of touching bodies by their serials (user index 2), which unlike
+// body indices are never reused.
+struct ContactPairKey {
+    int serialA, serialB;
+
+    unsigned int getHash() const {
+        return (unsigned int)serialA * 2654435761u ^ (unsigned int)serialB;
+    }
+
+    bool equals(const ContactPairKey& other) const {
+        return serialA == other.serialA && serialB == other.serialB;
+    }
+};
+
+struct TouchingPair {
+    int lastSeenTick;
+    int indexA, indexB;
+};
+
+// Hash of the world state after a fixed step, see hashWorldState.
+struct TickHash {
+    int tick; // -1 for none
+    int64_t hash;
+};
+
+// Hits kept until read. New ones are dropped when it's full.
+static const int MAX_PENDING_PROJECTILE_HITS = 4096;
+
+// Paint balls, simulated without rigid bodies: each fixed step they fall ballistically and
+// sweep a ray along the step (extended by their radius) against the world. The first body the
+// ray hits ends the projectile. Live projectiles are packed in parallel arrays (removal swaps
+// the last one in), which keep their capacity across spawns, so they never touch the heap
+// once warmed up.
+struct Projectiles {
+    btAlignedObjectArray<btVector3> positions;
+    btAlignedObjectArray<btVector3> velocities;
+    btAlignedObjectArray<btScalar> radii;
+    btAlignedObjectArray<btScalar> lifetimes; // seconds left
+    btAlignedObjectArray<int> ids;
+    btAlignedObjectArray<int> ownerSerials; // never hit this body, -1 for none
+    btAlignedObjectArray<int> masks; // collision groups hit
+    btHashMap<btHashInt, int> slotsById;
+    int nextId;
+    btAlignedObjectArray<PhysicsProjectileHit> hits; // not read yet
+};
+
+// Most proxies in sweep and prune broadphases, which allocate them all upfront.
+static const int SAP_MAX_HANDLES = 16384;
+
+// Which broadphase a world uses. Sweep and prune ones quantize aabbs within min and max:
+// bodies can leave them, but get slow to track and pair.
+struct BroadphaseConfig {
+    int kind;
+    btVector3 min, max;
+
+    bool operator==(const BroadphaseConfig& other) const {
+        if (kind != other.kind) return false;
+        return kind == PHYSICS_BROADPHASE_DBVT || (min == other.min && max == other.max);
+    }
+};
+
+static const BroadphaseConfig DEFAULT_BROADPHASE = {
+    PHYSICS_BROADPHASE_DBVT, btVector3(0.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f)
+};
+
+struct StepThread;
+
+// Native state for a world, behind a PhysicsWorld.
+// Each body (a rigid body, or the ghost object of a character) gets a stable index into
+// bodies (stored as its user index) that is reused after the body is deleted, so bulk
+// exports can be keyed by it. Bodies and everything they own are allocated from the world pools.
+struct WorldContext {
+    btDiscreteDynamicsWorld* world;
+    btDefaultCollisionConfiguration* configuration;
+    int threads; // > 1 for btDiscreteDynamicsWorldMt worlds
+    BroadphaseConfig broadphase;
+    int solver; // PHYSICS_SOLVER_*, of every solver of the world
+
+    // Profiling since the last readStepStats: microseconds in each PHYSICS_PHASE_* and stepping, see ProfiledStep.
+    double phaseMicros[PHYSICS_PHASE_COUNT];
+    double stepMicros;
+    int stepsProfiled;
+
+    // Stepping: the simulation advances in fixedTimeStep substeps, at most maxSubSteps
+    // per stepWorld. localTime mirrors bullet's leftover time, not simulated yet.
+    btScalar fixedTimeStep;
+    int maxSubSteps;
+    btScalar localTime;
+
+    // Sleeping: bodies slower than the thresholds for deactivationTime seconds go to sleep
+    // (0 never). Thresholds apply to bodies created from then on.
+    btScalar linearSleepThreshold, angularSleepThreshold;
+    btScalar deactivationTime;
+    btAlignedObjectArray<btCollisionObject*> bodies; // nullptr on free slots
+    btAlignedObjectArray<int> freeIndices;
+    btAlignedObjectArray<int> dirtyIndices; // bodies moved by the simulation since the last export
+    btHashMap<ShapeKey, SharedShape*> shapes; // shapes in use by bodies of this world
+    int nextSerial;
+    BodyOverlapFilter overlapFilter;
+    btGhostPairCallback ghostPairCallback; // keeps character ghost pairs up to date
+    btAlignedObjectArray<Character*> characters;
+
+    // Contact events: a ring of CONTACT_RING_CAPACITY, written after every fixed step while
+    // reportContacts. Otherwise contacts aren't scanned at all.
+    bool reportContacts;
+    btAlignedObjectArray<PhysicsContactEvent> contactEvents;
+    int64_t contactsWritten, contactsRead, contactsDropped;
+    btHashMap<ContactPairKey, TouchingPair> touchingPairs;
+    btAlignedObjectArray<ContactPairKey> endedPairs; // scratch for scanContacts
+    btHashMap<ContactPairKey, btPersistentManifold*> manifoldsByPair; // scratch for restoreWorld
+    btAlignedObjectArray<btCollisionObject*> regionBodies; // scratch for region queries
+    btAlignedObjectArray<btCollisionObject*> streamCreated; // scratch for applyCommands: bodies created by the stream
+    int tick; // fixed steps simulated
+
+    // Lockstep: deterministic worlds don't randomize the solver order, and hash the state
+    // of every body after each fixed step into a ring of PHYSICS_STATE_HASH_HISTORY, by tick.
+    bool deterministic;
+    btAlignedObjectArray<TickHash> stateHashes;
+
+    Projectiles projectiles;
+
+    StepThread* stepThread; // while a thread of its own steps the world, see startStepThread
+
+    ObjectPool<btRigidBody> bodyPool;
+    ObjectPool<TrackingMotionState> motionStatePool;
+    ObjectPool<btBoxShape> boxShapePool;
+    ObjectPool<btSphereShape> sphereShapePool;
+    ObjectPool<SharedShape> sharedShapePool;
+    ObjectPool<Character> characterPool;
+    ObjectPool<StaticBatch> staticBatchPool;
+};
+
+static void resetStepStats(WorldContext* ctx) {
+    for (double& micros : ctx->phaseMicros) micros = 0.0;
+    ctx->stepMicros = 0.0;
+    ctx->stepsProfiled = 0;
+}
+
+static void addPhaseTime(WorldContext* ctx, int phase, std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    ctx->phaseMicros[phase] += elapsed.count();
+}
+
+// Adds the time of its scope to a phase of the world.
+struct PhaseTimer {
+    PhaseTimer(WorldContext* ctx, int phase) : ctx(ctx), phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() { addPhaseTime(ctx, phase, start); }
+
+    WorldContext* ctx;
+    int phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Bullet profile zones (BT_PROFILE, which bullet calls through hooks even if built without its
+// own profiler) timed into the phases of the world this thread is stepping, if any. A zone inside
+// a timed one counts for it, and zones of worker threads are all inside one of the stepping thread.
+struct ProfileZone {
+    int phase; // -1 if not timed
+    std::chrono::steady_clock::time_point start;
+};
+
+static const int MAX_PROFILE_DEPTH = 32;
+static thread_local WorldContext* profiledWorld = nullptr;
+static thread_local ProfileZone profileZones[MAX_PROFILE_DEPTH];
+static thread_local int profileDepth = 0;
+static thread_local bool profileTiming = false; // whether a zone in the stack is timed
+
+static int phaseOfZone(const char* name) {
+    static const struct { const char* name; int phase; } zones[] = {
+        { "updateAabbs", PHYSICS_PHASE_BROADPHASE },
+        { "calculateOverlappingPairs", PHYSICS_PHASE_BROADPHASE },
+        { "dispatchAllCollisionPairs", PHYSICS_PHASE_NARROWPHASE },
+        { "createPredictiveContacts", PHYSICS_PHASE_NARROWPHASE },
+        { "calculateSimulationIslands", PHYSICS_PHASE_ISLANDS },
+        { "updateActivationState", PHYSICS_PHASE_ISLANDS },
+        { "solveConstraints", PHYSICS_PHASE_SOLVER },
+        { "predictUnconstraintMotion", PHYSICS_PHASE_INTEGRATION },
+        { "integrateTransforms", PHYSICS_PHASE_INTEGRATION },
+        { "synchronizeMotionStates", PHYSICS_PHASE_INTEGRATION },
+        { "updateActions", PHYSICS_PHASE_CHARACTERS },
+    };
+    for (const auto& zone : zones) {
+        if (strcmp(name, zone.name) == 0) return zone.phase;
+    }
+    return -1;
+}
+
+static void enterProfileZone(const char* name) {
+    if (profiledWorld == nullptr) return;
+    int depth = profileDepth++;
+    if (depth >= MAX_PROFILE_DEPTH) return;
+    ProfileZone& zone = profileZones[depth];
+    zone.phase = profileTiming ? -1 : phaseOfZone(name);
+    if (zone.phase >= 0) {
+        profileTiming = true;
+        zone.start = std::chrono::steady_clock::now();
+    }
+}
+
+static void leaveProfileZone() {
+    if (profiledWorld == nullptr || profileDepth == 0) return;
+    int depth = --profileDepth;
+    if (depth >= MAX_PROFILE_DEPTH || profileZones[depth].phase < 0) return;
+    profileTiming = false;
+    addPhaseTime(profiledWorld, profileZones[depth].phase, profileZones[depth].start);
+}
+
+// Profiles the bullet steps of a world done in its scope, on this thread.
+struct ProfiledStep {
+    explicit ProfiledStep(WorldContext* ctx) : ctx(ctx), start(std::chrono::steady_clock::now()) {
+        profiledWorld = ctx;
+        profileDepth = 0;
+        profileTiming = false;
+    }
+
+    ~ProfiledStep() {
+        profiledWorld = nullptr;
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        ctx->stepMicros += elapsed.count();
+    }
+
+    WorldContext* ctx;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Motion state that records in the world dirty list the bodies bullet moves.
+// Bullet only calls setWorldTransform for active bodies, so sleeping ones never get there.
+// transform is the interpolated one: the body at the current time, between fixed steps.
+class TrackingMotionState : public btMotionState {
+public:
+    TrackingMotionState(WorldContext* ctx, const btTransform& transform)
+        : ctx(ctx), transform(transform), index(-1), dirty(false) {}
+
+    void getWorldTransform(btTransform& worldTrans) const override {
+        worldTrans = transform;
+    }
+
+    void setWorldTransform(const btTransform& worldTrans) override {
+        transform = worldTrans;
+        if (!dirty) {
+            dirty = true;
+            ctx->dirtyIndices.push_back(index);
+        }
+    }
+
+    WorldContext* ctx;
+    btTransform transform;
+    int index;
+    bool dirty; // true while index is in ctx->dirtyIndices
+};
+
+// Highest step a character climbs while walking.
+static const btScalar CHARACTER_STEP_HEIGHT = 0.35f;
+
+// What a character controller keeps between steps, besides the ghost transform.
+struct CharacterMotion {
+    btVector3 walkDirection;
+    btVector3 jumpPosition;
+    btScalar verticalVelocity;
+    btScalar verticalOffset;
+    btScalar velocityTimeInterval;
+    bool useWalkDirection;
+    bool wasOnGround;
+    bool wasJumping;
+};
+
+// Character controller whose motion can be saved and restored, for world snapshots.
+class CharacterController : public btKinematicCharacterController {
+public:
+    CharacterController(btPairCachingGhostObject* ghost, btConvexShape* shape, btScalar stepHeight, const btVector3& up)
+        : btKinematicCharacterController(ghost, shape, stepHeight, up) {}
+
+    void saveMotion(CharacterMotion& motion) const {
+        motion.walkDirection = m_walkDirection;
+        motion.jumpPosition = m_jumpPosition;
+        motion.verticalVelocity = m_verticalVelocity;
+        motion.verticalOffset = m_verticalOffset;
+        motion.velocityTimeInterval = m_velocityTimeInterval;
+        motion.useWalkDirection = m_useWalkDirection;
+        motion.wasOnGround = m_wasOnGround;
+        motion.wasJumping = m_wasJumping;
+    }
+
+    void restoreMotion(const CharacterMotion& motion) {
+        m_walkDirection = motion.walkDirection;
+        m_normalizedDirection = motion.walkDirection.fuzzyZero() ? btVector3(0.0f, 0.0f, 0.0f) : motion.walkDirection.normalized();
+        m_jumpPosition = motion.jumpPosition;
+        m_verticalVelocity = motion.verticalVelocity;
+        m_verticalOffset = motion.verticalOffset;
+        m_velocityTimeInterval = motion.velocityTimeInterval;
+        m_useWalkDirection = motion.useWalkDirection;
+        m_wasOnGround = motion.wasOnGround;
+        m_wasJumping = motion.wasJumping;
+    }
+};
+
+// Dynamics world whose bodies go to sleep after the deactivationTime of its WorldContext (the
+// world user info) instead of bullet's gDeactivationTime, a process-wide global that worlds
+// stepped on different threads would race on. Otherwise the same as bullet's updateActivationState.
+template <class World>
+class SleepingWorld : public World {
+public:
+    using World::World;
+
+    void updateActivationState(btScalar timeStep) override {
+        BT_PROFILE("updateActivationState");
+        btScalar deactivationTime = ((WorldContext*) this->getWorldUserInfo())->deactivationTime;
+        for (int i = 0; i < this->m_nonStaticRigidBodies.size(); i++) {
+            btRigidBody* body = this->m_nonStaticRigidBodies[i];
+            body->updateDeactivation(timeStep);
+            if (wantsSleeping(body, deactivationTime)) {
+                if (body->isStaticOrKinematicObject()) {
+                    body->setActivationState(ISLAND_SLEEPING);
+                    continue;
+                }
+                if (body->getActivationState() == ACTIVE_TAG) body->setActivationState(WANTS_DEACTIVATION);
+                if (body->getActivationState() == ISLAND_SLEEPING) {
+                    body->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+                    body->setLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+                }
+            } else if (body->getActivationState() != DISABLE_DEACTIVATION) {
+                body->setActivationState(ACTIVE_TAG);
+            }
+        }
+    }
+
+private:
+    // btRigidBody::wantsSleeping, with the deactivation time of this world (0 never sleeps)
+    static bool wantsSleeping(const btRigidBody* body, btScalar deactivationTime) {
+        int state = body->getActivationState();
+        if (state == DISABLE_DEACTIVATION || gDisableDeactivation || deactivationTime == 0.0f) return false;
+        if (state == ISLAND_SLEEPING || state == WANTS_DEACTIVATION) return true;
+        return body->getDeactivationTime() > deactivationTime;
+    }
+};
+
+// A player: a ghost object moved by a kinematic character controller (a world action)
+// instead of a rigid body, so it never goes through the constraint solver nor wakes up
+// the islands it walks into. Stored as the ghost user pointer.
+struct Character {
+    Character(WorldContext* ctx, btConvexShape* shape)
+        : ctx(ctx), controller(&ghost, shape, CHARACTER_STEP_HEIGHT, btVector3(0.0f, 1.0f, 0.0f)), index(-1), dirty(false) {}
+
+    WorldContext* ctx;
+    btPairCachingGhostObject ghost;
+    CharacterController controller;
+    int index;
+    bool dirty; // true while index is in ctx->dirtyIndices
+};
+
+// The character a body belongs to, or nullptr for rigid bodies.
+static Character* asCharacter(const btCollisionObject* body) {
+    if (body->getInternalType() != btCollisionObject::CO_GHOST_OBJECT) return nullptr;
+    return (Character*) body->getUserPointer();
+}
+
+// Argument words per opcode, indexed by PHYSICS_CMD_*.
+static const int COMMAND_ARGS[] = { 8, 7, 7, 11, 1, 10, 1, 5, 2, 6 };
+// Opcodes there are, so a new one only needs its entry above to be accepted.
+static const int COMMAND_COUNT = sizeof(COMMAND_ARGS) / sizeof(COMMAND_ARGS[0]);
+static_assert(COMMAND_COUNT == PHYSICS_CMD_RADIAL_IMPULSE + 1, "COMMAND_ARGS needs an entry per PHYSICS_CMD_*");
+// Words of the shortest command making a result (a create or a projectile spawn), opcode included.
+static const int MIN_RESULT_COMMAND_WORDS =
+        1 + btMin(COMMAND_ARGS[PHYSICS_CMD_CREATE], COMMAND_ARGS[PHYSICS_CMD_SPAWN_PROJECTILE]);
+
+static int allocBodyIndex(WorldContext* ctx, btCollisionObject* body) {
+    int index;
+    if (ctx->freeIndices.size() > 0) {
+        index = ctx->freeIndices[ctx->freeIndices.size() - 1];
+        ctx->freeIndices.pop_back();
+        ctx->bodies[index] = body;
+    } else {
+        index = ctx->bodies.size();
+        ctx->bodies.push_back(body);
+    }
+    body->setUserIndex(index);
+    body->setUserIndex2(ctx->nextSerial++);
+    return index;
+}
+
+static void freeBodyIndex(WorldContext* ctx, btCollisionObject* body) {
+    int index = body->getUserIndex();
+    ctx->bodies[index] = nullptr;
+    ctx->freeIndices.push_back(index);
+}
+
+// Returns a shape for the given body type and size, shared with every other body
+// of the world that uses the same one. Release it with releaseShape.
+static btCollisionShape* acquireShape(WorldContext* ctx, int type, const btVector3& size) {
+    ShapeKey key;
+    key.sphere = type == PHYSICS_TYPE_BULLET;
+    key.x = size.getX();
+    key.y = key.sphere ? 0.0f : size.getY();
+    key.z = key.sphere ? 0.0f : size.getZ();
+
+    SharedShape** found = ctx->shapes.find(key);
+    if (found != nullptr) {
+        (*found)->refs++;
+        return (*found)->shape;
+    }
+
+    auto* shared = ctx->sharedShapePool.create();
+    shared->key = key;
+    shared->refs = 1;
+    if (key.sphere) {
+        shared->shape = ctx->sphereShapePool.create(key.x);
+    } else {
+        btVector3 halfExtents = size / btScalar(2.0f);
+        shared->shape = ctx->boxShapePool.create(halfExtents);
+    }
+    shared->shape->setUserPointer(shared);
+    ctx->shapes.insert(key, shared);
+    return shared->shape;
+}
+
+// Drops a reference from acquireShape, deleting the shape when no body uses it anymore.
+static void releaseShape(WorldContext* ctx, btCollisionShape* shape) {
+    auto* shared = (SharedShape*) shape->getUserPointer();
+    if (--shared->refs > 0) return;
+    ctx->shapes.remove(shared->key);
+    if (shared->key.sphere) {
+        ctx->sphereShapePool.destroy((btSphereShape*) shared->shape);
+    } else {
+        ctx->boxShapePool.destroy((btBoxShape*) shared->shape);
+    }
+    ctx->sharedShapePool.destroy(shared);
+}
+
+// Creates a rigid body with the given shape, owned by it from now on, and adds it to the world.
+// Filtering as in createBody.
+static btRigidBody* createRigidBody(WorldContext* ctx, btCollisionShape* shape, btScalar mass, const btTransform& transform,
+        int group, int mask, const btCollisionObject* owner) {
+    // calculate inertia, only for non-static objects
+    btVector3 inertia(0.0f, 0.0f, 0.0f);
+    if (mass != 0.0f) {
+        shape->calculateLocalInertia(mass, inertia);
+    }
+
+    // create body, with their motionState and so
+    auto* motionState = ctx->motionStatePool.create(ctx, transform);
+    btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, shape, inertia);
+    auto* body = ctx->bodyPool.create(rbInfo);
+    body->setSleepingThresholds(ctx->linearSleepThreshold, ctx->angularSleepThreshold);
+
+    // add to world
+    motionState->index = allocBodyIndex(ctx, body);
+    body->setUserIndex3(owner != nullptr ? owner->getUserIndex2() : -1);
+    if (group != 0) {
+        ctx->world->addRigidBody(body, group, mask);
+    } else {
+        ctx->world->addRigidBody(body);
+    }
+    return body;
+}
+
+// Creates a body and adds it to the world. It collides with bodies whose group is in its mask
+// and the other way around; group 0 keeps the bullet default filtering. Never collides with owner.
+// Characters get a ghost object driven by a character controller, other types a rigid body.
+static btCollisionObject* createBody(WorldContext* ctx, int type, btScalar mass, const btVector3& pos, const btVector3& size,
+        int group = 0, int mask = 0, const btCollisionObject* owner = nullptr) {
+    // get a shape, shared with the bodies of the same kind and size
+    btCollisionShape* shape = acquireShape(ctx, type, size);
+
+    // create world transform
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin(pos);
+
+    if (type == PHYSICS_TYPE_CHARACTER) {
+        auto* character = ctx->characterPool.create(ctx, (btConvexShape*) shape);
+        btPairCachingGhostObject* ghost = &character->ghost;
+        ghost->setWorldTransform(transform);
+        ghost->setCollisionShape(shape);
+        ghost->setCollisionFlags(btCollisionObject::CF_CHARACTER_OBJECT);
+        ghost->setUserPointer(character);
+        character->controller.setGravity(ctx->world->getGravity());
+        character->index = allocBodyIndex(ctx, ghost);
+        ghost->setUserIndex3(owner != nullptr ? owner->getUserIndex2() : -1);
+        if (group != 0) {
+            ctx->world->addCollisionObject(ghost, group, mask);
+        } else {
+            ctx->world->addCollisionObject(ghost, btBroadphaseProxy::CharacterFilter,
+                                           btBroadphaseProxy::StaticFilter | btBroadphaseProxy::DefaultFilter);
+        }
+        ctx->world->addAction(&character->controller);
+        ctx->characters.push_back(character);
+        return ghost;
+    }
+
+    btRigidBody* body = createRigidBody(ctx, shape, mass, transform, group, mask, owner);
+
+    // set ccd for bullets
+    if (type == PHYSICS_TYPE_BULLET) {
+        body->setCcdMotionThreshold(0.2f);
+    }
+
+    // set friction for static objects
+    if (type == PHYSICS_TYPE_BOX && mass == 0.0f) {
+        //body->setFriction(0.95f);
+    }
+    return body;
+}
+
+static void deleteBody(WorldContext* ctx, btCollisionObject* body) {
+    Character* character = asCharacter(body);
+    if (character != nullptr) {
+        ctx->world->removeAction(&character->controller);
+        ctx->world->removeCollisionObject(body);
+        ctx->characters.remove(character);
+        freeBodyIndex(ctx, body);
+        releaseShape(ctx, body->getCollisionShape());
+        ctx->characterPool.destroy(character);
+        return;
+    }
+    auto* rigidBody = (btRigidBody*) body;
+    ctx->world->removeRigidBody(rigidBody);
+    freeBodyIndex(ctx, body);
+    btCollisionShape* shape = body->getCollisionShape();
+    if (shape->isCompound()) {
+        auto* batch = (StaticBatch*) shape->getUserPointer();
+        for (int i = 0; i < batch->shape.getNumChildShapes(); i++) {
+            releaseShape(ctx, batch->shape.getChildShape(i));
+        }
+        ctx->staticBatchPool.destroy(batch);
+    } else {
+        releaseShape(ctx, shape);
+    }
+    ctx->motionStatePool.destroy((TrackingMotionState*) rigidBody->getMotionState());
+    ctx->bodyPool.destroy(rigidBody);
+}
+
+// Creates a static body made of the given boxes, which get ids 0 to count - 1 as children of it.
+static btRigidBody* createStaticBatch(WorldContext* ctx, const PhysicsStaticBox* boxes, int count, int group, int mask) {
+    auto* batch = ctx->staticBatchPool.create();
+    batch->shape.setUserPointer(batch);
+    for (int i = 0; i < count; i++) {
+        const PhysicsStaticBox& box = boxes[i];
+        btVector3 size(box.size[0], box.size[1], box.size[2]);
+        btTransform transform(btQuaternion(box.rotation[0], box.rotation[1], box.rotation[2], box.rotation[3]),
+                              btVector3(box.position[0], box.position[1], box.position[2]));
+        batch->shape.addChildShape(transform, acquireShape(ctx, PHYSICS_TYPE_BOX, size));
+        batch->childIds.push_back(i);
+    }
+    return createRigidBody(ctx, &batch->shape, 0.0f, btTransform::getIdentity(), group, mask, nullptr);
+}
+
+// Removes the box with the given id from a static batch body, deleting the body with the last one.
+static void removeStaticBatchChild(WorldContext* ctx, btCollisionObject* body, int childId) {
+    btCollisionShape* shape = body->getCollisionShape();
+    if (!shape->isCompound()) return;
+    auto* batch = (StaticBatch*) shape->getUserPointer();
+    int i = batch->childIds.findLinearSearch(childId);
+    if (i == batch->childIds.size()) return;
+
+    btCollisionShape* child = batch->shape.getChildShape(i);
+    batch->shape.removeChildShapeByIndex(i); // moves the last child to i, so do the same with ids
+    batch->childIds.swap(i, batch->childIds.size() - 1);
+    batch->childIds.pop_back();
+    releaseShape(ctx, child);
+    if (batch->childIds.size() == 0) {
+        deleteBody(ctx, body);
+    } else {
+        ctx->world->updateSingleAabb(body);
+    }
+}
+
+static void setBodyTransform(btCollisionObject* body, const btVector3& pos, const btQuaternion& rotation) {
+    Character* character = asCharacter(body);
+    if (character != nullptr) {
+        character->controller.warp(pos); // characters don't rotate
+        return;
+    }
+    btTransform transform(rotation, pos);
+    body->setWorldTransform(transform);
+    // teleport: don't interpolate from the old position
+    body->setInterpolationWorldTransform(transform);
+    ((TrackingMotionState*) ((btRigidBody*) body)->getMotionState())->transform = transform;
+}
+
+// The body transform at the last fixed step, or interpolated to the current time.
+static btTransform getBodyTransform(const btCollisionObject* body, bool interpolated) {
+    Character* character = asCharacter(body);
+    if (character != nullptr) {
+        btTransform transform = body->getWorldTransform();
+        // extrapolated by its velocity, as bullet does with rigid bodies
+        if (interpolated) transform.getOrigin() += character->controller.getLinearVelocity() * character->ctx->localTime;
+        return transform;
+    }
+    if (interpolated) return ((const TrackingMotionState*) ((const btRigidBody*) body)->getMotionState())->transform;
+    return body->getWorldTransform();
+}
+
+static btVector3 getBodyLinearVelocity(const btCollisionObject* body) {
+    Character* character = asCharacter(body);
+    if (character != nullptr) return character->controller.getLinearVelocity();
+    return ((const btRigidBody*) body)->getLinearVelocity();
+}
+
+static btVector3 getBodyAngularVelocity(const btCollisionObject* body) {
+    if (asCharacter(body) != nullptr) return btVector3(0.0f, 0.0f, 0.0f);
+    return ((const btRigidBody*) body)->getAngularVelocity();
+}
+
+// Makes a character walk at the horizontal part of walkVelocity (units per second) until told
+// otherwise, and jump at jumpSpeed if > 0 and it's on the ground. Vertical motion is up to the
+// controller: gravity, jumps and steps.
+static void moveCharacter(Character* character, const btVector3& walkVelocity, btScalar jumpSpeed) {
+    btVector3 walk(walkVelocity.getX(), 0.0f, walkVelocity.getZ());
+    character->controller.setVelocityForTimeInterval(walk, BT_LARGE_FLOAT);
+    if (jumpSpeed > 0.0f && character->controller.canJump()) {
+        character->controller.jump(btVector3(0.0f, jumpSpeed, 0.0f));
+    }
+}
+
+static void setBodyVelocity(btCollisionObject* body, const btVector3& linearVelocity, const btVector3& angularVelocity) {
+    Character* character = asCharacter(body);
+    if (character != nullptr) {
+        moveCharacter(character, linearVelocity, 0.0f);
+        return;
+    }
+    auto* rigidBody = (btRigidBody*) body;
+    if (!linearVelocity.fuzzyZero() || !angularVelocity.fuzzyZero()) {
+        rigidBody->activate();
+    }
+    rigidBody->setLinearVelocity(linearVelocity);
+    rigidBody->setAngularVelocity(angularVelocity);
+}
+
+// Marks body as exported, returning whether it was moved by the simulation since the last export.
+static bool takeBodyDirty(btCollisionObject* body) {
+    Character* character = asCharacter(body);
+    bool& dirty = character != nullptr ? character->dirty : ((TrackingMotionState*) ((btRigidBody*) body)->getMotionState())->dirty;
+    bool wasDirty = dirty;
+    dirty = false;
+    return wasDirty;
+}
+
+// Writes the state of body into slot i of a exportBodyStates-layout buffer with the given capacity.
+static void writeBodyState(btCollisionObject* body, bool interpolated, int i, int capacity, float* array) {
+    float* positions = array;
+    float* quaternions = positions + capacity * 3;
+    float* linearVelocities = quaternions + capacity * 4;
+    float* angularVelocities = linearVelocities + capacity * 3;
+
+    btTransform t = getBodyTransform(body, interpolated);
+    const btVector3& origin = t.getOrigin();
+    positions[i*3 + 0] = origin.getX();
+    positions[i*3 + 1] = origin.getY();
+    positions[i*3 + 2] = origin.getZ();
+
+    btQuaternion quaternion = t.getRotation();
+    quaternions[i*4 + 0] = quaternion.getX();
+    quaternions[i*4 + 1] = quaternion.getY();
+    quaternions[i*4 + 2] = quaternion.getZ();
+    quaternions[i*4 + 3] = quaternion.getW();
+
+    btVector3 linearVelocity = getBodyLinearVelocity(body);
+    linearVelocities[i*3 + 0] = linearVelocity.getX();
+    linearVelocities[i*3 + 1] = linearVelocity.getY();
+    linearVelocities[i*3 + 2] = linearVelocity.getZ();
+
+    btVector3 angularVelocity = getBodyAngularVelocity(body);
+    angularVelocities[i*3 + 0] = angularVelocity.getX();
+    angularVelocities[i*3 + 1] = angularVelocity.getY();
+    angularVelocities[i*3 + 2] = angularVelocity.getZ();
+}
+
+// Task scheduler shared by all multithreaded worlds, created on first use.
+// Null if the bullet build has no thread support (BT_THREADSAFE off).
+static btITaskScheduler* taskScheduler = nullptr;
+static bool taskSchedulerCreated = false;
+
+static btITaskScheduler* getTaskScheduler() {
+    if (!taskSchedulerCreated) {
+        taskSchedulerCreated = true;
+        taskScheduler = btCreateDefaultTaskScheduler();
+        if (taskScheduler != nullptr) {
+            btSetTaskScheduler(taskScheduler);
+        } else {
+            LOGW("bullet built without thread support, multithreaded worlds will run single threaded");
+        }
+    }
+    return taskScheduler;
+}
+
+// How many threads a world asking for the given count will actually use.
+static int resolveThreads(int threads) {
+    if (threads <= 1 || getTaskScheduler() == nullptr) return 1;
+    return btMin(threads, taskScheduler->getMaxNumThreads());
+}
+
+// Same as bullet stepSimulation defaults: a single 1/60 seconds substep per call.
+static void setDefaultStepping(WorldContext* ctx) {
+    ctx->fixedTimeStep = btScalar(1.0f) / btScalar(60.0f);
+    ctx->maxSubSteps = 1;
+}
+
+static void pushContactEvent(WorldContext* ctx, const PhysicsContactEvent& event) {
+    if (ctx->contactsWritten - ctx->contactsRead == CONTACT_RING_CAPACITY) {
+        ctx->contactsRead++;
+        ctx->contactsDropped++;
+    }
+    ctx->contactEvents[(int)(ctx->contactsWritten & (CONTACT_RING_CAPACITY - 1))] = event;
+    ctx->contactsWritten++;
+}
+
+// Index of the body with the given serial, or -1 if it was deleted.
+static int liveBodyIndex(WorldContext* ctx, int index, int serial) {
+    btCollisionObject* body = ctx->bodies[index];
+    return body != nullptr && body->getUserIndex2() == serial ? index : -1;
+}
+
+// Scans the contact manifolds after a fixed step, writing begin events for pairs that
+// started touching, persist events for touching pairs where some body is awake, and end
+// events for pairs that stopped touching.
+static void scanContacts(WorldContext* ctx) {
+    btDispatcher* dispatcher = ctx->world->getDispatcher();
+    int manifolds = dispatcher->getNumManifolds();
+    for (int i = 0; i < manifolds; i++) {
+        btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+        const btManifoldPoint* deepest = nullptr;
+        btScalar impulse = 0.0f;
+        for (int j = 0; j < manifold->getNumContacts(); j++) {
+            const btManifoldPoint& pt = manifold->getContactPoint(j);
+            if (pt.getDistance() >= 0.0f) continue;
+            impulse += pt.getAppliedImpulse();
+            if (deepest == nullptr || pt.getDistance() < deepest->getDistance()) deepest = &pt;
+        }
+        if (deepest == nullptr) continue; // close, but not touching
+
+        const btCollisionObject* a = manifold->getBody0();
+        const btCollisionObject* b = manifold->getBody1();
+        btVector3 point = deepest->getPositionWorldOnB();
+        btVector3 normal = deepest->m_normalWorldOnB;
+        if (a->getUserIndex2() > b->getUserIndex2()) { // same order for a pair on every step
+            btSwap(a, b);
+            point = deepest->getPositionWorldOnA();
+            normal = -normal;
+        }
+
+        ContactPairKey key = { a->getUserIndex2(), b->getUserIndex2() };
+        TouchingPair* pair = ctx->touchingPairs.find(key);
+        int kind;
+        if (pair == nullptr) {
+            TouchingPair touching = { ctx->tick, a->getUserIndex(), b->getUserIndex() };
+            ctx->touchingPairs.insert(key, touching);
+            kind = PHYSICS_CONTACT_BEGIN;
+        } else {
+            if (pair->lastSeenTick == ctx->tick) continue; // another manifold of the pair (i.e. character ghosts)
+            pair->lastSeenTick = ctx->tick;
+            if (!a->isActive() && !b->isActive()) continue; // sleeping piles don't report
+            kind = PHYSICS_CONTACT_PERSIST;
+        }
+        PhysicsContactEvent event = {
+            a->getUserIndex(), b->getUserIndex(),
+            { point.getX(), point.getY(), point.getZ() },
+            { normal.getX(), normal.getY(), normal.getZ() },
+            impulse, kind
+        };
+        pushContactEvent(ctx, event);
+    }
+
+    // pairs not seen on this step stopped touching
+    btAlignedObjectArray<ContactPairKey>& ended = ctx->endedPairs;
+    ended.resize(0);
+    for (int i = 0; i < ctx->touchingPairs.size(); i++) {
+        const TouchingPair* pair = ctx->touchingPairs.getAtIndex(i);
+        if (pair->lastSeenTick == ctx->tick) continue;
+        ContactPairKey key = ctx->touchingPairs.getKeyAtIndex(i);
+        ended.push_back(key);
+        PhysicsContactEvent event = {
+            liveBodyIndex(ctx, pair->indexA, key.serialA), liveBodyIndex(ctx, pair->indexB, key.serialB),
+            { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f },
+            0.0f, PHYSICS_CONTACT_END
+        };
+        pushContactEvent(ctx, event);
+    }
+    for (int i = 0; i < ended.size(); i++) {
+        ctx->touchingPairs.remove(ended[i]);
+    }
+}
+
+// Adds a projectile, returning its id. ownerSerial is the serial of the body it never hits, or -1.
+static int spawnProjectile(WorldContext* ctx, const btVector3& pos, const btVector3& velocity,
+        btScalar radius, btScalar lifetime, int ownerSerial, int mask) {
+    Projectiles& p = ctx->projectiles;
+    int id = p.nextId++;
+    p.slotsById.insert(id, p.ids.size());
+    p.positions.push_back(pos);
+    p.velocities.push_back(velocity);
+    p.radii.push_back(radius);
+    p.lifetimes.push_back(lifetime);
+    p.ids.push_back(id);
+    p.ownerSerials.push_back(ownerSerial);
+    p.masks.push_back(mask);
+    return id;
+}
+
+static void removeProjectileAt(Projectiles& p, int slot) {
+    int last = p.ids.size() - 1;
+    p.slotsById.remove(p.ids[slot]);
+    if (slot != last) {
+        p.positions[slot] = p.positions[last];
+        p.velocities[slot] = p.velocities[last];
+        p.radii[slot] = p.radii[last];
+        p.lifetimes[slot] = p.lifetimes[last];
+        p.ids[slot] = p.ids[last];
+        p.ownerSerials[slot] = p.ownerSerials[last];
+        p.masks[slot] = p.masks[last];
+        p.slotsById.insert(p.ids[slot], slot);
+    }
+    p.positions.pop_back();
+    p.velocities.pop_back();
+    p.radii.pop_back();
+    p.lifetimes.pop_back();
+    p.ids.pop_back();
+    p.ownerSerials.pop_back();
+    p.masks.pop_back();
+}
+
+// Removes every projectile and unread hit, keeping the arrays allocated.
+static void clearProjectiles(Projectiles& p) {
+    p.positions.resize(0);
+    p.velocities.resize(0);
+    p.radii.resize(0);
+    p.lifetimes.resize(0);
+    p.ids.resize(0);
+    p.ownerSerials.resize(0);
+    p.masks.resize(0);
+    p.slotsById.clear();
+    p.hits.resize(0);
+}
+
+// Removes the projectile with the given id, if it's still alive. Doesn't report a hit.
+static void removeProjectile(WorldContext* ctx, int id) {
+    Projectiles& p = ctx->projectiles;
+    int* slot = p.slotsById.find(id);
+    if (slot != nullptr) removeProjectileAt(p, *slot);
+}
+
+static void pushProjectileHit(Projectiles& p, const PhysicsProjectileHit& hit) {
+    if (p.hits.size() < MAX_PENDING_PROJECTILE_HITS) p.hits.push_back(hit);
+}
+
+// Closest hit along a projectile step, skipping the body that fired it.
+struct ProjectileRayCallback : public btCollisionWorld::ClosestRayResultCallback {
+    ProjectileRayCallback(const btVector3& from, const btVector3& to, int ownerSerial)
+        : ClosestRayResultCallback(from, to), ownerSerial(ownerSerial) {}
+
+    bool needsCollision(btBroadphaseProxy* proxy0) const override {
+        if (!ClosestRayResultCallback::needsCollision(proxy0)) return false;
+        auto* object = (const btCollisionObject*) proxy0->m_clientObject;
+        return ownerSerial < 0 || object->getUserIndex2() != ownerSerial;
+    }
+
+    int ownerSerial;
+};
+
+// Advances every projectile one fixed step of timeStep seconds, ending the ones that hit
+// something or ran out of lifetime.
+static void stepProjectiles(WorldContext* ctx, btScalar timeStep) {
+    Projectiles& p = ctx->projectiles;
+    btVector3 gravityStep = ctx->world->getGravity() * timeStep;
+    int i = 0;
+    while (i < p.ids.size()) {
+        p.velocities[i] += gravityStep;
+        btVector3 from = p.positions[i];
+        btVector3 to = from + p.velocities[i] * timeStep;
+        btVector3 reach = to;
+        if (!p.velocities[i].fuzzyZero()) reach += p.velocities[i].normalized() * p.radii[i];
+
+        ProjectileRayCallback callback(from, reach, p.ownerSerials[i]);
+        callback.m_collisionFilterGroup = -1; // so every body mask accepts the projectile
+        callback.m_collisionFilterMask = p.masks[i];
+        ctx->world->rayTest(from, reach, callback);
+        if (callback.hasHit()) {
+            const btVector3& point = callback.m_hitPointWorld;
+            const btVector3& normal = callback.m_hitNormalWorld;
+            pushProjectileHit(p, PhysicsProjectileHit{
+                p.ids[i], callback.m_collisionObject->getUserIndex(),
+                { point.getX(), point.getY(), point.getZ() },
+                { normal.getX(), normal.getY(), normal.getZ() }
+            });
+            removeProjectileAt(p, i);
+            continue;
+        }
+
+        p.positions[i] = to;
+        p.lifetimes[i] -= timeStep;
+        if (p.lifetimes[i] <= 0.0f) {
+            pushProjectileHit(p, PhysicsProjectileHit{
+                p.ids[i], -1, { to.getX(), to.getY(), to.getZ() }, { 0.0f, 0.0f, 0.0f }
+            });
+            removeProjectileAt(p, i);
+            continue;
+        }
+        i++;
+    }
+}
+
+// Characters are moved by their controllers, without motion states, so they're dirty after every step.
+static void markCharactersDirty(WorldContext* ctx) {
+    for (int i = 0; i < ctx->characters.size(); i++) {
+        Character* character = ctx->characters[i];
+        if (!character->dirty) {
+            character->dirty = true;
+            ctx->dirtyIndices.push_back(character->index);
+        }
+    }
+}
+
+// FNV-1a over 32 bit words. Floats are hashed by their bits, so any difference at all counts.
+static const uint64_t STATE_HASH_BASIS = 14695981039346656037ull;
+static const uint64_t STATE_HASH_PRIME = 1099511628211ull;
+
+static uint64_t hashWord(uint64_t hash, uint32_t word) {
+    return (hash ^ word) * STATE_HASH_PRIME;
+}
+
+static uint64_t hashVector(uint64_t hash, const btVector3& v) {
+    static_assert(sizeof(btScalar) == sizeof(uint32_t), "hashing single precision bullet");
+    uint32_t bits[3];
+    memcpy(bits, v.m_floats, sizeof(bits));
+    return hashWord(hashWord(hashWord(hash, bits[0]), bits[1]), bits[2]);
+}
+
+// Hashes the transform, velocities and activation of every body, in index order, and every
+// projectile. Peers stepping the same commands deterministically get the same hash each tick.
+static int64_t hashWorldState(WorldContext* ctx) {
+    uint64_t hash = STATE_HASH_BASIS;
+    for (int i = 0; i < ctx->bodies.size(); i++) {
+        btCollisionObject* body = ctx->bodies[i];
+        if (body == nullptr) continue;
+        const btTransform& transform = body->getWorldTransform();
+        hash = hashWord(hash, (uint32_t) i);
+        hash = hashWord(hash, (uint32_t) body->getUserIndex2());
+        hash = hashWord(hash, (uint32_t) body->getActivationState());
+        hash = hashVector(hash, transform.getOrigin());
+        for (int row = 0; row < 3; row++) hash = hashVector(hash, transform.getBasis()[row]);
+        hash = hashVector(hash, getBodyLinearVelocity(body));
+        hash = hashVector(hash, getBodyAngularVelocity(body));
+    }
+    const Projectiles& p = ctx->projectiles;
+    for (int i = 0; i < p.ids.size(); i++) {
+        hash = hashWord(hash, (uint32_t) p.ids[i]);
+        hash = hashVector(hash, p.positions[i]);
+        hash = hashVector(hash, p.velocities[i]);
+    }
+    return (int64_t) hash;
+}
+
+static void clearStateHashes(WorldContext* ctx) {
+    for (int i = 0; i < ctx->stateHashes.size(); i++) ctx->stateHashes[i].tick = -1;
+}
+
+static void onInternalTick(btDynamicsWorld* world, btScalar timeStep) {
+    auto* ctx = (WorldContext*) world->getWorldUserInfo();
+    PhaseTimer timer(ctx, PHYSICS_PHASE_TICK);
+    ctx->tick++;
+    if (ctx->reportContacts) scanContacts(ctx);
+    stepProjectiles(ctx, timeStep);
+    markCharactersDirty(ctx);
+    if (ctx->deterministic) {
+        TickHash& entry = ctx->stateHashes[ctx->tick % PHYSICS_STATE_HASH_HISTORY];
+        entry.tick = ctx->tick;
+        entry.hash = hashWorldState(ctx);
+    }
+}
+
+static btBroadphaseInterface* newBroadphase(const BroadphaseConfig& config) {
+    switch (config.kind) {
+        case PHYSICS_BROADPHASE_SAP: return new btAxisSweep3(config.min, config.max, SAP_MAX_HANDLES);
+        case PHYSICS_BROADPHASE_SAP_32: return new bt32BitAxisSweep3(config.min, config.max, SAP_MAX_HANDLES);
+        default: return new btDbvtBroadphase();
+    }
+}
+
+// btMLCPSolver with the MLCP algorithm it solves islands with, which bullet leaves to the caller to delete.
+template <typename Algorithm>
+struct OwningMLCPSolver : public btMLCPSolver {
+    OwningMLCPSolver() : btMLCPSolver(&algorithm) {}
+
+    Algorithm algorithm;
+};
+
+static btConstraintSolver* newSolver(int kind) {
+    switch (kind) {
+        case PHYSICS_SOLVER_NNCG: return new btNNCGConstraintSolver();
+        case PHYSICS_SOLVER_MLCP_DANTZIG: return new OwningMLCPSolver<btDantzigSolver>();
+        case PHYSICS_SOLVER_MLCP_LEMKE: return new OwningMLCPSolver<btLemkeSolver>();
+        case PHYSICS_SOLVER_MLCP_PGS: return new OwningMLCPSolver<btSolveProjectedGaussSeidel>();
+        default: return new btSequentialImpulseConstraintSolver();
+    }
+}
+
+static const int DEFAULT_SOLVER_ITERATIONS = 10;
+static const float DEFAULT_WARMSTARTING_FACTOR = 0.85f;
+
+// Solver settings, on top of bullet's defaults (DEFAULT_SOLVER_ITERATIONS, SIMD and
+// DEFAULT_WARMSTARTING_FACTOR). Kept by pooled worlds until set again.
+static void setSolverSettings(WorldContext* ctx, int iterations, bool simd, float warmstartingFactor) {
+    btContactSolverInfo& info = ctx->world->getSolverInfo();
+    info.m_numIterations = btMax(iterations, 1);
+    if (simd) {
+        info.m_solverMode |= SOLVER_SIMD;
+    } else {
+        info.m_solverMode &= ~SOLVER_SIMD;
+    }
+    info.m_warmstartingFactor = warmstartingFactor;
+    if (warmstartingFactor > 0.0f) {
+        info.m_solverMode |= SOLVER_USE_WARMSTARTING;
+    } else {
+        info.m_solverMode &= ~SOLVER_USE_WARMSTARTING;
+    }
+}
+
+// Same as bullet defaults: bodies sleep after 2 seconds under 0.8 units/s and 1 rad/s.
+static void setDefaultSleeping(WorldContext* ctx) {
+    ctx->linearSleepThreshold = 0.8f;
+    ctx->angularSleepThreshold = 1.0f;
+    ctx->deactivationTime = 2.0f;
+}
+
+// Lockstep mode. Deterministic worlds give the same results, bit by bit, for the same commands
+// at the same ticks on the same build: the solver doesn't shuffle constraints, the rounding mode
+// is reset before stepping, and each tick is hashed (see hashWorldState). Only for single
+// threaded worlds, as the Mt dispatcher creates contact manifolds in thread order.
+static void setDeterministic(WorldContext* ctx, bool deterministic) {
+    ctx->deterministic = deterministic;
+    if (deterministic) {
+        ctx->world->getSolverInfo().m_solverMode &= ~SOLVER_RANDMIZE_ORDER;
+        ctx->world->getConstraintSolver()->reset(); // its random seed too
+    }
+    clearStateHashes(ctx);
+}
+
+// Creates a world stepped by the given number of threads. With more than one, uses the
+// Mt world, dispatcher and a pool of solvers so islands are solved in parallel.
+static WorldContext* newWorldContext(int threads, const BroadphaseConfig& broadphaseConfig = DEFAULT_BROADPHASE,
+                                     int solverKind = PHYSICS_SOLVER_SI) {
+    threads = resolveThreads(threads);
+    if (solverKind < 0 || solverKind >= PHYSICS_SOLVER_COUNT) solverKind = PHYSICS_SOLVER_SI;
+
+    auto* broadphase = newBroadphase(broadphaseConfig);
+    auto* configuration = new btDefaultCollisionConfiguration();
+    btDiscreteDynamicsWorld* world;
+    if (threads > 1) {
+        auto* dispatcher = new btCollisionDispatcherMt(configuration);
+        btAlignedObjectArray<btConstraintSolver*> solvers;
+        for (int i = 0; i < threads; i++) solvers.push_back(newSolver(solverKind));
+        auto* solverPool = new btConstraintSolverPoolMt(&solvers[0], threads); // deletes them
+        world = new SleepingWorld<btDiscreteDynamicsWorldMt>(dispatcher, broadphase, solverPool, nullptr, configuration);
+    } else {
+        auto* dispatcher = new btCollisionDispatcher(configuration);
+        world = new SleepingWorld<btDiscreteDynamicsWorld>(dispatcher, broadphase, newSolver(solverKind), configuration);
+    }
+    world->setGravity(btVector3(0.0f, -10.0f, 0.0f));
+    if (solverKind >= PHYSICS_SOLVER_MLCP_DANTZIG) {
+        // an MLCP builds a matrix of all the constraints solved together: islands are batched
+        // into groups of 128 constraints by default, which cost a lot more than solving them apart
+        world->getSolverInfo().m_minimumSolverBatchSize = 1;
+    }
+    auto* ctx = new WorldContext();
+    ctx->world = world;
+    ctx->configuration = configuration;
+    ctx->threads = threads;
+    ctx->broadphase = broadphaseConfig;
+    ctx->solver = solverKind;
+    resetStepStats(ctx);
+    ctx->localTime = 0.0f;
+    setDefaultStepping(ctx);
+    setDefaultSleeping(ctx);
+    ctx->nextSerial = 0;
+    ctx->reportContacts = true;
+    ctx->contactEvents.resize(CONTACT_RING_CAPACITY);
+    ctx->contactsWritten = ctx->contactsRead = ctx->contactsDropped = 0;
+    ctx->tick = 0;
+    ctx->stateHashes.resize(PHYSICS_STATE_HASH_HISTORY);
+    setDeterministic(ctx, false);
+    ctx->projectiles.nextId = 0;
+    ctx->stepThread = nullptr;
+    world->setInternalTickCallback(onInternalTick, ctx);
+    btSetCustomEnterProfileZoneFunc(enterProfileZone); // global, but the same for every world
+    btSetCustomLeaveProfileZoneFunc(leaveProfileZone);
+    world->getPairCache()->setOverlapFilterCallback(&ctx->overlapFilter);
+    world->getPairCache()->setInternalGhostPairCallback(&ctx->ghostPairCallback);
+    return ctx;
+}
+
+// Sets up the globals bullet reads while stepping for this world.
+static void prepareStep(WorldContext* ctx) {
+    if (ctx->threads > 1 && taskScheduler->getNumThreads() != ctx->threads) {
+        taskScheduler->setNumThreads(ctx->threads);
+    }
+    // the thread is shared with the JVM and other native code, which may leave another mode set
+    if (ctx->deterministic) std::fesetround(FE_TONEAREST);
+}
+
+// Advances the world step seconds, in up to maxSubSteps fixed steps. Time that doesn't
+// fill a fixed step is carried over to the next call, and time over the substep budget
+// is dropped (the world slows down instead of spiking). Returns the substeps simulated.
+static int stepWorld(WorldContext* ctx, btScalar step) {
+    prepareStep(ctx);
+    // same bookkeeping bullet does internally, which doesn't expose it
+    if (ctx->maxSubSteps > 0) {
+        ctx->localTime += step;
+        if (ctx->localTime >= ctx->fixedTimeStep) {
+            int steps = (int)(ctx->localTime / ctx->fixedTimeStep);
+            ctx->localTime -= steps * ctx->fixedTimeStep;
+        }
+    } else {
+        ctx->localTime = 0.0f;
+    }
+    ProfiledStep profiled(ctx);
+    int steps = ctx->world->stepSimulation(step, ctx->maxSubSteps, ctx->fixedTimeStep);
+    ctx->stepsProfiled += steps;
+    return steps;
+}
+
+// Advances the world exactly ticks fixed steps, for lockstep simulations driven by tick
+// instead of time. Time left over by stepWorld is dropped.
+static void stepWorldTicks(WorldContext* ctx, int ticks) {
+    prepareStep(ctx);
+    ctx->localTime = 0.0f;
+    ProfiledStep profiled(ctx);
+    ctx->stepsProfiled += ticks;
+    for (int i = 0; i < ticks; i++) {
+        // a single step of exactly fixedTimeStep, without adding to (or interpolating by) bullet's own leftover time
+        ctx->world->stepSimulation(ctx->fixedTimeStep, 0, ctx->fixedTimeStep);
+    }
+}
+
+// Removes every body, leaving the world as new but keeping everything allocated:
+// body, shape and motion state pools, the index table, the collision configuration
+// (with its manifold and algorithm pools) and the broadphase pair cache.
+static void resetWorldContext(WorldContext* ctx) {
+    for (int i = ctx->bodies.size() - 1; i >= 0; i--) {
+        if (ctx->bodies[i] != nullptr) deleteBody(ctx, ctx->bodies[i]);
+    }
+    ctx->bodies.resize(0);
+    ctx->freeIndices.resize(0);
+    ctx->dirtyIndices.resize(0);
+    ctx->touchingPairs.clear();
+    ctx->contactsWritten = ctx->contactsRead = ctx->contactsDropped = 0;
+    ctx->tick = 0;
+    clearStateHashes(ctx);
+    resetStepStats(ctx);
+    clearProjectiles(ctx->projectiles);
+    ctx->world->getConstraintSolver()->reset();
+    ctx->world->setGravity(btVector3(0.0f, -10.0f, 0.0f));
+}
+
+static void deleteWorldContext(WorldContext* ctx) {
+    resetWorldContext(ctx);
+    auto* world = ctx->world;
+    auto* broadphase = world->getBroadphase();
+    auto* solver = world->getConstraintSolver();
+    auto* dispatcher = world->getDispatcher();
+    delete world;
+    delete broadphase;
+    delete solver;
+    delete dispatcher;
+    delete ctx->configuration;
+    delete ctx;
+}
+
+// Reset worlds ready to be handed out by create (for the same thread count, broadphase and solver), so
+// game mode and map changes don't reallocate a world from scratch. Only touched from one thread
+// (the GL thread in the app).
+static const int MAX_POOLED_WORLDS = 2;
+static btAlignedObjectArray<PhysicsWorld*> pooledWorlds;
+
+// Bodies are handed out as the bullet collision objects themselves.
+static btCollisionObject* asObject(PhysicsBody* body) {
+    return reinterpret_cast<btCollisionObject*>(body);
+}
+
+static const btCollisionObject* asObject(const PhysicsBody* body) {
+    return reinterpret_cast<const btCollisionObject*>(body);
+}
+
+static PhysicsBody* asBody(btCollisionObject* body) {
+    return reinterpret_cast<PhysicsBody*>(body);
+}
+
+PhysicsWorld::~PhysicsWorld() {
+    stopStepThread();
+    deleteWorldContext(ctx);
+}
+
+PhysicsWorldConfig PhysicsWorld::defaultConfig() {
+    PhysicsWorldConfig config;
+    memset(&config, 0, sizeof(config));
+    config.threads = 1;
+    config.broadphase = PHYSICS_BROADPHASE_DBVT;
+    config.linearSleepThreshold = 0.8f;
+    config.angularSleepThreshold = 1.0f;
+    config.deactivationTime = 2.0f;
+    config.solver = PHYSICS_SOLVER_SI;
+    config.solverIterations = DEFAULT_SOLVER_ITERATIONS;
+    config.simdSolver = 1;
+    config.warmstartingFactor = DEFAULT_WARMSTARTING_FACTOR;
+    return config;
+}
+
+PhysicsWorld* PhysicsWorld::create(const PhysicsWorldConfig& config) {
+    int threads = resolveThreads(config.threads);
+    BroadphaseConfig broadphase = {
+        config.broadphase,
+        btVector3(config.boundsMin[0], config.boundsMin[1], config.boundsMin[2]),
+        btVector3(config.boundsMax[0], config.boundsMax[1], config.boundsMax[2])
+    };
+    int solver = config.solver >= 0 && config.solver < PHYSICS_SOLVER_COUNT ? config.solver : PHYSICS_SOLVER_SI;
+    PhysicsWorld* world = nullptr;
+    for (int i = 0; i < pooledWorlds.size(); i++) {
+        WorldContext* pooled = pooledWorlds[i]->ctx;
+        if (pooled->threads == threads && pooled->broadphase == broadphase && pooled->solver == solver) {
+            world = pooledWorlds[i];
+            pooledWorlds.removeAtIndex(i);
+            setDefaultStepping(pooled);
+            pooled->reportContacts = true;
+            ::setDeterministic(pooled, false);
+            break;
+        }
+    }
+    if (world == nullptr) world = new PhysicsWorld(newWorldContext(threads, broadphase, solver));
+    setSolverSettings(world->ctx, config.solverIterations, config.simdSolver != 0, config.warmstartingFactor);
+    world->ctx->linearSleepThreshold = config.linearSleepThreshold;
+    world->ctx->angularSleepThreshold = config.angularSleepThreshold;
+    world->ctx->deactivationTime = config.deactivationTime;
+    return world;
+}
+
+void PhysicsWorld::destroy(PhysicsWorld* world) {
+    if (pooledWorlds.size() < MAX_POOLED_WORLDS) {
+        world->reset();
+        pooledWorlds.push_back(world);
+    } else {
+        delete world;
+    }
+}
+
+void PhysicsWorld::prewarm(int count, int bodies, int threads) {
+    while (pooledWorlds.size() < btMin(count, MAX_POOLED_WORLDS)) {
+        auto* ctx = newWorldContext(threads);
+        ctx->bodies.reserve(bodies);
+        ctx->freeIndices.reserve(bodies);
+        ctx->dirtyIndices.reserve(bodies);
+        ctx->bodyPool.reserve(bodies);
+        ctx->motionStatePool.reserve(bodies);
+        pooledWorlds.push_back(new PhysicsWorld(ctx));
+    }
+}
+
+void PhysicsWorld::reset() {
+    stopStepThread();
+    resetWorldContext(ctx);
+}
+
+void PhysicsWorld::getPoolStats(int32_t dst[PHYSICS_POOL_COUNT * 2]) const {
+    const int32_t stats[PHYSICS_POOL_COUNT * 2] = {
+        ctx->bodyPool.liveCount(), ctx->bodyPool.pooledCount(),
+        ctx->motionStatePool.liveCount(), ctx->motionStatePool.pooledCount(),
+        ctx->boxShapePool.liveCount(), ctx->boxShapePool.pooledCount(),
+        ctx->sphereShapePool.liveCount(), ctx->sphereShapePool.pooledCount(),
+        ctx->sharedShapePool.liveCount(), ctx->sharedShapePool.pooledCount(),
+        ctx->characterPool.liveCount(), ctx->characterPool.pooledCount(),
+        ctx->staticBatchPool.liveCount(), ctx->staticBatchPool.pooledCount(),
+    };
+    memcpy(dst, stats, sizeof(stats));
+}
+
+void PhysicsWorld::setStepping(float fixedTimeStep, int maxSubSteps) {
+    ctx->fixedTimeStep = fixedTimeStep;
+    ctx->maxSubSteps = maxSubSteps;
+}
+
+int PhysicsWorld::simulate(float step) {
+    return stepWorld(ctx, step);
+}
+
+float PhysicsWorld::interpolationFraction() const {
+    if (ctx->maxSubSteps == 0) return 0.0f;
+    return ctx->localTime / ctx->fixedTimeStep;
+}
+
+void PhysicsWorld::setDeterministic(bool deterministic) {
+    ::setDeterministic(ctx, deterministic);
+}
+
+void PhysicsWorld::stepTicks(int ticks) {
+    stepWorldTicks(ctx, ticks);
+}
+
+int PhysicsWorld::tick() const {
+    return ctx->tick;
+}
+
+int PhysicsWorld::threads() const {
+    return ctx->threads;
+}
+
+int64_t PhysicsWorld::stateHash(int tick) const {
+    if (tick < 0) return 0;
+    const TickHash& entry = ctx->stateHashes[tick % PHYSICS_STATE_HASH_HISTORY];
+    return entry.tick == tick ? entry.hash : 0;
+}
+
+void PhysicsWorld::readStepStats(float dst[PHYSICS_STATS_FLOATS]) {
+    for (int i = 0; i < PHYSICS_PHASE_COUNT; i++) dst[i] = (float)(ctx->phaseMicros[i] / 1000.0);
+    dst[PHYSICS_STAT_STEP_MILLIS] = (float)(ctx->stepMicros / 1000.0);
+    dst[PHYSICS_STAT_STEPS] = (float) ctx->stepsProfiled;
+    btDispatcher* dispatcher = ctx->world->getDispatcher();
+    int contacts = 0;
+    for (int i = 0; i < dispatcher->getNumManifolds(); i++) contacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+    dst[PHYSICS_STAT_PAIRS] = (float) ctx->world->getPairCache()->getNumOverlappingPairs();
+    dst[PHYSICS_STAT_MANIFOLDS] = (float) dispatcher->getNumManifolds();
+    dst[PHYSICS_STAT_CONTACTS] = (float) contacts;
+    resetStepStats(ctx);
+}
+
+PhysicsBody* PhysicsWorld::createBody(int type, float mass, const float position[3], const float size[3],
+        int group, int mask, const PhysicsBody* owner) {
+    btVector3 pos(position[0], position[1], position[2]);
+    btVector3 extents(size[0], size[1], size[2]);
+    return asBody(::createBody(ctx, type, mass, pos, extents, group, mask, asObject(owner)));
+}
+
+PhysicsBody* PhysicsWorld::createStaticBatch(const PhysicsStaticBox* boxes, int count, int group, int mask) {
+    if (count <= 0) return nullptr;
+    return asBody(::createStaticBatch(ctx, boxes, count, group, mask));
+}
+
+void PhysicsWorld::deleteBody(PhysicsBody* body) {
+    ::deleteBody(ctx, asObject(body));
+}
+
+PhysicsBody* PhysicsWorld::body(int index) const {
+    if (index < 0 || index >= ctx->bodies.size()) return nullptr;
+    return asBody(ctx->bodies[index]);
+}
+
+int PhysicsWorld::bodyIndex(const PhysicsBody* body) {
+    return asObject(body)->getUserIndex();
+}
+
+void PhysicsWorld::getBodyOpenGLMatrix(const PhysicsBody* body, bool interpolated, float dst[16]) {
+    getBodyTransform(asObject(body), interpolated).getOpenGLMatrix(dst);
+}
+
+void PhysicsWorld::getBodyState(const PhysicsBody* body, float dst[PHYSICS_BODY_STATE_FLOATS]) {
+    const btCollisionObject* object = asObject(body);
+    const btTransform& t = object->getWorldTransform();
+    const btVector3& origin = t.getOrigin();
+    dst[0] = origin.getX();
+    dst[1] = origin.getY();
+    dst[2] = origin.getZ();
+
+    btQuaternion quaternion = t.getRotation();
+    dst[3] = quaternion.getX();
+    dst[4] = quaternion.getY();
+    dst[5] = quaternion.getZ();
+    dst[6] = quaternion.getW();
+
+    btVector3 linearVelocity = getBodyLinearVelocity(object);
+    dst[7] = linearVelocity.getX();
+    dst[8] = linearVelocity.getY();
+    dst[9] = linearVelocity.getZ();
+
+    btVector3 angularVelocity = getBodyAngularVelocity(object);
+    dst[10] = angularVelocity.getX();
+    dst[11] = angularVelocity.getY();
+    dst[12] = angularVelocity.getZ();
+}
+
+void PhysicsWorld::setBodyTransform(PhysicsBody* body, const float position[3], const float rotation[4]) {
+    ::setBodyTransform(asObject(body), btVector3(position[0], position[1], position[2]),
+                       btQuaternion(rotation[0], rotation[1], rotation[2], rotation[3]));
+}
+
+void PhysicsWorld::setBodyVelocity(PhysicsBody* body, const float linearVelocity[3], const float angularVelocity[3]) {
+    ::setBodyVelocity(asObject(body), btVector3(linearVelocity[0], linearVelocity[1], linearVelocity[2]),
+                      btVector3(angularVelocity[0], angularVelocity[1], angularVelocity[2]));
+}
+
+int PhysicsWorld::exportBodyStates(bool interpolated, float* dst, int capacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    int count = ctx->bodies.size();
+    if (count > capacity) return -count;
+
+    for (int i = 0; i < count; i++) {
+        btCollisionObject* body = ctx->bodies[i];
+        if (body == nullptr || body->isStaticObject()) continue;
+        writeBodyState(body, interpolated, i, capacity, dst);
+    }
+    return count;
+}
+
+// Bodies whose broadphase aabb overlaps a box or a sphere, filtered by collision group. The dbvt
+// broadphase (and the dbvt sweep and prune keeps for ray and aabb tests) only visits the nodes
+// overlapping the region, so a query costs about the bodies near it rather than all of them.
+struct RegionCallback : public btBroadphaseAabbCallback {
+    RegionCallback(btAlignedObjectArray<btCollisionObject*>& found, const btVector3& center, btScalar radius, int mask)
+        : found(found), center(center), radius(radius), mask(mask) {}
+
+    bool process(const btBroadphaseProxy* proxy) override {
+        if ((proxy->m_collisionFilterGroup & mask) == 0) return true;
+        if (radius > btScalar(0.0f)) {
+            // the aabbs are only tested against the bounds of the sphere so far
+            btVector3 closest = center;
+            closest.setMax(proxy->m_aabbMin);
+            closest.setMin(proxy->m_aabbMax);
+            if (closest.distance2(center) > radius * radius) return true;
+        }
+        btCollisionObject* body = (btCollisionObject*) proxy->m_clientObject;
+        if (body->getUserIndex() >= 0) found.push_back(body);
+        return true;
+    }
+
+    btAlignedObjectArray<btCollisionObject*>& found;
+    btVector3 center;
+    btScalar radius;
+    int mask;
+};
+
+// Fills ctx->regionBodies with the bodies of the mask groups in the sphere, or the box of the given
+// size if radius <= 0.
+static void queryRegion(WorldContext* ctx, const btVector3& center, const btVector3& size, btScalar radius, int mask) {
+    btVector3 halfExtents = radius > btScalar(0.0f) ? btVector3(radius, radius, radius) : size / btScalar(2.0f);
+    ctx->regionBodies.resize(0);
+    RegionCallback callback(ctx->regionBodies, center, radius, mask);
+    ctx->world->getBroadphase()->aabbTest(center - halfExtents, center + halfExtents, callback);
+}
+
+// Pushes the dynamic bodies of the mask groups within radius of center away from it, by impulse
+// at the center falling off linearly to nothing at radius. Returns how many bodies were pushed.
+static int applyRadialImpulse(WorldContext* ctx, const btVector3& center, btScalar radius, btScalar impulse, int mask) {
+    if (radius <= btScalar(0.0f)) return 0;
+    queryRegion(ctx, center, btVector3(0.0f, 0.0f, 0.0f), radius, mask);
+    int pushed = 0;
+    for (int i = 0; i < ctx->regionBodies.size(); i++) {
+        btCollisionObject* body = ctx->regionBodies[i];
+        if (body->isStaticOrKinematicObject() || asCharacter(body) != nullptr) continue; // characters only move by walking
+        btRigidBody* rigidBody = (btRigidBody*) body;
+        btVector3 offset = rigidBody->getCenterOfMassPosition() - center;
+        btScalar distance = offset.length();
+        btScalar falloff = btScalar(1.0f) - btMin(distance / radius, btScalar(1.0f));
+        if (falloff <= btScalar(0.0f)) continue;
+        btVector3 direction = distance > SIMD_EPSILON ? offset / distance : btVector3(0.0f, 1.0f, 0.0f);
+        rigidBody->activate();
+        rigidBody->applyCentralImpulse(direction * (impulse * falloff));
+        pushed++;
+    }
+    return pushed;
+}
+
+int PhysicsWorld::queryRegion(const PhysicsRegionQuery& query, int32_t* dst, int capacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    ::queryRegion(ctx, btVector3(query.center[0], query.center[1], query.center[2]),
+                  btVector3(query.size[0], query.size[1], query.size[2]), query.radius, query.mask);
+    int count = ctx->regionBodies.size();
+    if (count > capacity) return -count;
+    for (int i = 0; i < count; i++) dst[i] = ctx->regionBodies[i]->getUserIndex();
+    return count;
+}
+
+// Sequential reader over the words of a command stream.
+struct CommandReader {
+    const int32_t* words;
+    int position;
+    int length;
+
+    int32_t nextInt() { return words[position++]; }
+    float nextFloat() {
+        float value;
+        memcpy(&value, &words[position++], sizeof(float));
+        return value;
+    }
+    btVector3 nextVector3() {
+        btScalar x = nextFloat(), y = nextFloat(), z = nextFloat();
+        return btVector3(x, y, z);
+    }
+};
+
+static btCollisionObject* resolveBodyRef(WorldContext* ctx, const btAlignedObjectArray<btCollisionObject*>& created, int ref) {
+    if (ref >= 0) return ref < ctx->bodies.size() ? ctx->bodies[ref] : nullptr;
+    int n = -ref - 1;
+    return n < created.size() ? created[n] : nullptr;
+}
+
+int PhysicsWorld::applyCommands(const int32_t* words, int length, int64_t* results, int resultCapacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    CommandReader reader = { words, 0, length };
+    // resize(0), as clear() would free it
+    btAlignedObjectArray<btCollisionObject*>& created = ctx->streamCreated;
+    created.resize(0);
+    int resultCount = 0;
+
+    while (reader.position < reader.length) {
+        int32_t op = reader.nextInt();
+        if (op < PHYSICS_CMD_SET_TRANSFORM || op >= COMMAND_COUNT) break;
+        if (reader.position + COMMAND_ARGS[op] > reader.length) break;
+
+        if (op == PHYSICS_CMD_CREATE) {
+            int32_t type = reader.nextInt();
+            float mass = reader.nextFloat();
+            btVector3 pos = reader.nextVector3();
+            btVector3 size = reader.nextVector3();
+            int32_t group = reader.nextInt();
+            int32_t mask = reader.nextInt();
+            btCollisionObject* owner = resolveBodyRef(ctx, created, reader.nextInt());
+            btCollisionObject* body = ::createBody(ctx, type, mass, pos, size, group, mask, owner);
+            if (resultCount < resultCapacity) {
+                results[resultCount*2 + 0] = (int64_t)(intptr_t)body;
+                results[resultCount*2 + 1] = body->getUserIndex();
+            }
+            resultCount++;
+            created.push_back(body);
+            continue;
+        }
+        if (op == PHYSICS_CMD_SPAWN_PROJECTILE) {
+            btVector3 pos = reader.nextVector3();
+            btVector3 velocity = reader.nextVector3();
+            float radius = reader.nextFloat();
+            float lifetime = reader.nextFloat();
+            btCollisionObject* owner = resolveBodyRef(ctx, created, reader.nextInt());
+            int32_t mask = reader.nextInt();
+            int id = spawnProjectile(ctx, pos, velocity, radius, lifetime, owner != nullptr ? owner->getUserIndex2() : -1, mask);
+            if (resultCount < resultCapacity) {
+                results[resultCount*2 + 0] = 0;
+                results[resultCount*2 + 1] = id;
+            }
+            resultCount++;
+            continue;
+        }
+        if (op == PHYSICS_CMD_REMOVE_PROJECTILE) {
+            removeProjectile(ctx, reader.nextInt());
+            continue;
+        }
+        if (op == PHYSICS_CMD_RADIAL_IMPULSE) {
+            btVector3 center = reader.nextVector3();
+            float radius = reader.nextFloat();
+            float impulse = reader.nextFloat();
+            ::applyRadialImpulse(ctx, center, radius, impulse, reader.nextInt());
+            continue;
+        }
+
+        btCollisionObject* body = resolveBodyRef(ctx, created, reader.nextInt());
+        if (op == PHYSICS_CMD_SET_TRANSFORM) {
+            btVector3 pos = reader.nextVector3();
+            btScalar qx = reader.nextFloat(), qy = reader.nextFloat(), qz = reader.nextFloat(), qw = reader.nextFloat();
+            if (body != nullptr) ::setBodyTransform(body, pos, btQuaternion(qx, qy, qz, qw));
+        } else if (op == PHYSICS_CMD_SET_VELOCITY) {
+            btVector3 linearVelocity = reader.nextVector3();
+            btVector3 angularVelocity = reader.nextVector3();
+            if (body != nullptr) ::setBodyVelocity(body, linearVelocity, angularVelocity);
+        } else if (op == PHYSICS_CMD_APPLY_IMPULSE) {
+            btVector3 impulse = reader.nextVector3();
+            btVector3 relPos = reader.nextVector3();
+            if (body != nullptr && asCharacter(body) == nullptr) { // characters only move by walking
+                body->activate();
+                ((btRigidBody*) body)->applyImpulse(impulse, relPos);
+            }
+        } else if (op == PHYSICS_CMD_MOVE_CHARACTER) {
+            btVector3 walkVelocity = reader.nextVector3();
+            float jumpSpeed = reader.nextFloat();
+            Character* character = body != nullptr ? asCharacter(body) : nullptr;
+            if (character != nullptr) moveCharacter(character, walkVelocity, jumpSpeed);
+        } else if (op == PHYSICS_CMD_REMOVE_BATCH_CHILD) {
+            int32_t child = reader.nextInt();
+            if (body != nullptr) removeStaticBatchChild(ctx, body, child);
+        } else if (op == PHYSICS_CMD_DESTROY) {
+            if (body != nullptr) {
+                // forget it if it was created in this stream, so later refs don't dangle
+                int n = created.findLinearSearch(body);
+                if (n < created.size()) created[n] = nullptr;
+                ::deleteBody(ctx, body);
+            }
+        }
+    }
+    return resultCount;
+}
+
+int PhysicsWorld::exportChangedBodyStates(bool interpolated, float* dst, int capacity, int32_t* changed, int changedCapacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    int slots = ctx->bodies.size();
+    if (slots > capacity || slots > changedCapacity) return -slots;
+
+    int count = 0;
+    for (int n = 0; n < ctx->dirtyIndices.size(); n++) {
+        int i = ctx->dirtyIndices[n];
+        btCollisionObject* body = ctx->bodies[i];
+        if (body == nullptr) continue; // deleted after it moved
+        if (!takeBodyDirty(body)) continue; // slot reused by a new body
+        writeBodyState(body, interpolated, i, capacity, dst);
+        changed[count++] = i;
+    }
+    ctx->dirtyIndices.resize(0);
+    return count;
+}
+
+int PhysicsWorld::exportActivationStates(int32_t counts[PHYSICS_ACTIVATION_STATE_COUNT], int32_t* bits, int bitsCapacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    int slots = ctx->bodies.size();
+    for (int i = 0; i < PHYSICS_ACTIVATION_STATE_COUNT; i++) counts[i] = 0;
+    bool writeBits = (slots + 31) / 32 <= bitsCapacity;
+    if (writeBits) memset(bits, 0, ((slots + 31) / 32) * sizeof(int32_t));
+
+    for (int i = 0; i < slots; i++) {
+        btCollisionObject* body = ctx->bodies[i];
+        if (body == nullptr || body->isStaticObject()) continue;
+        int state = body->getActivationState();
+        if (state >= ACTIVE_TAG && state <= DISABLE_SIMULATION) counts[state - 1]++;
+        if (writeBits && body->isActive()) bits[i >> 5] |= (int32_t)(1u << (i & 31));
+    }
+    return writeBits ? slots : -slots;
+}
+
+int PhysicsWorld::readContactEvents(PhysicsContactEvent* dst, int capacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    int count = (int) btMin((int64_t) capacity, ctx->contactsWritten - ctx->contactsRead);
+    for (int i = 0; i < count; i++) {
+        dst[i] = ctx->contactEvents[(int)((ctx->contactsRead + i) & (CONTACT_RING_CAPACITY - 1))];
+    }
+    ctx->contactsRead += count;
+    return count;
+}
+
+int64_t PhysicsWorld::droppedContactEvents() const {
+    return ctx->contactsDropped;
+}
+
+void PhysicsWorld::setContactEvents(bool enabled) {
+    if (enabled == ctx->reportContacts) return;
+    ctx->reportContacts = enabled;
+    // pairs touching now begin again once enabled, and the events not read won't be
+    ctx->touchingPairs.clear();
+    ctx->contactsRead = ctx->contactsWritten;
+}
+
+static bool castRay(WorldContext* ctx, const PhysicsRayQuery& query, PhysicsRayHit& hit) {
+    btVector3 from(query.from[0], query.from[1], query.from[2]);
+    btVector3 to(query.to[0], query.to[1], query.to[2]);
+    btCollisionWorld::ClosestRayResultCallback callback(from, to);
+    callback.m_collisionFilterGroup = -1; // so every body mask accepts the ray
+    callback.m_collisionFilterMask = query.mask;
+    ctx->world->rayTest(from, to, callback);
+    if (!callback.hasHit()) {
+        hit = PhysicsRayHit{ -1, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f };
+        return false;
+    }
+    const btVector3& point = callback.m_hitPointWorld;
+    const btVector3& normal = callback.m_hitNormalWorld;
+    hit = PhysicsRayHit{
+        callback.m_collisionObject->getUserIndex(),
+        { point.getX(), point.getY(), point.getZ() },
+        { normal.getX(), normal.getY(), normal.getZ() },
+        callback.m_closestHitFraction
+    };
+    return true;
+}
+
+int PhysicsWorld::castRays(const PhysicsRayQuery* rays, PhysicsRayHit* hits, int count) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    int hitCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (castRay(ctx, rays[i], hits[i])) hitCount++;
+    }
+    return hitCount;
+}
+
+int PhysicsWorld::exportProjectiles(PhysicsProjectileState* dst, int capacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    const Projectiles& p = ctx->projectiles;
+    int count = p.ids.size();
+    if (count > capacity) return -count;
+
+    for (int i = 0; i < count; i++) {
+        const btVector3& position = p.positions[i];
+        const btVector3& velocity = p.velocities[i];
+        dst[i] = PhysicsProjectileState{
+            p.ids[i],
+            { position.getX(), position.getY(), position.getZ() },
+            { velocity.getX(), velocity.getY(), velocity.getZ() }
+        };
+    }
+    return count;
+}
+
+int PhysicsWorld::readProjectileHits(PhysicsProjectileHit* dst, int capacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    btAlignedObjectArray<PhysicsProjectileHit>& hits = ctx->projectiles.hits;
+    int count = btMin(capacity, hits.size());
+    for (int i = 0; i < count; i++) {
+        dst[i] = hits[i];
+    }
+    for (int i = count; i < hits.size(); i++) {
+        hits[i - count] = hits[i];
+    }
+    hits.resize(hits.size() - count);
+    return count;
+}
+
+int PhysicsWorld::exportCharacterStates(PhysicsCharacterState* dst, int capacity) {
+    PhaseTimer timer(ctx, PHYSICS_PHASE_SYNC);
+    int count = ctx->characters.size();
+    if (count > capacity) return -count;
+
+    for (int i = 0; i < count; i++) {
+        const Character* character = ctx->characters[i];
+        dst[i] = PhysicsCharacterState{ character->index, character->controller.onGround() ? 1 : 0 };
+    }
+    return count;
+}
+
+// World snapshots (see snapshot) are a SnapshotHeader followed by the BodySnapshot of every
+// non-static body and, if taken with contacts, the ContactSnapshot of every manifold.
+// Bullet types are copied as they are in memory, so snapshots are only good for this process.
+struct SnapshotHeader {
+    int32_t version; // SNAPSHOT_VERSION
+    int32_t bodies;
+    int32_t contacts;
+    int32_t tick;
+    float localTime;
+};
+
+static const int32_t SNAPSHOT_VERSION = 2;
+
+struct BodySnapshot {
+    btTransform transform;
+    btTransform interpolationTransform; // rigid bodies only, as the rest until character
+    btTransform renderTransform; // the interpolated one, in the motion state
+    btVector3 linearVelocity;
+    btVector3 angularVelocity;
+    btVector3 interpolationLinearVelocity;
+    btVector3 interpolationAngularVelocity;
+    CharacterMotion character; // characters only
+    int32_t index;
+    int32_t serial; // restored only if the body at index is still the same
+    int32_t activationState;
+    btScalar deactivationTime;
+};
+
+// Contact points of a manifold, which warm start the solver on the next step.
+struct ContactSnapshot {
+    btManifoldPoint points[MANIFOLD_CACHE_SIZE];
+    int32_t serialA, serialB; // of manifold bodies 0 and 1
+    int32_t count;
+};
+
+static void takeBodySnapshot(btCollisionObject* body, BodySnapshot& snapshot) {
+    memset((void*) &snapshot, 0, sizeof(snapshot));
+    snapshot.transform = body->getWorldTransform();
+    snapshot.index = body->getUserIndex();
+    snapshot.serial = body->getUserIndex2();
+    snapshot.activationState = body->getActivationState();
+    snapshot.deactivationTime = body->getDeactivationTime();
+    Character* character = asCharacter(body);
+    if (character != nullptr) {
+        character->controller.saveMotion(snapshot.character);
+        return;
+    }
+    auto* rigidBody = (btRigidBody*) body;
+    snapshot.interpolationTransform = rigidBody->getInterpolationWorldTransform();
+    snapshot.renderTransform = ((TrackingMotionState*) rigidBody->getMotionState())->transform;
+    snapshot.linearVelocity = rigidBody->getLinearVelocity();
+    snapshot.angularVelocity = rigidBody->getAngularVelocity();
+    snapshot.interpolationLinearVelocity = rigidBody->getInterpolationLinearVelocity();
+    snapshot.interpolationAngularVelocity = rigidBody->getInterpolationAngularVelocity();
+}
+
+// Puts the body in the dirty list, so the next exportChangedBodyStates reports it.
+static void markBodyDirty(WorldContext* ctx, btCollisionObject* body) {
+    Character* character = asCharacter(body);
+    bool& dirty = character != nullptr ? character->dirty : ((TrackingMotionState*) ((btRigidBody*) body)->getMotionState())->dirty;
+    if (!dirty) {
+        dirty = true;
+        ctx->dirtyIndices.push_back(body->getUserIndex());
+    }
+}
+
+static void restoreBodySnapshot(WorldContext* ctx, btCollisionObject* body, const BodySnapshot& snapshot) {
+    body->setWorldTransform(snapshot.transform);
+    body->forceActivationState(snapshot.activationState);
+    body->setDeactivationTime(snapshot.deactivationTime);
+    markBodyDirty(ctx, body);
+    Character* character = asCharacter(body);
+    if (character != nullptr) {
+        character->controller.restoreMotion(snapshot.character);
+        return;
+    }
+    auto* rigidBody = (btRigidBody*) body;
+    rigidBody->setInterpolationWorldTransform(snapshot.interpolationTransform);
+    ((TrackingMotionState*) rigidBody->getMotionState())->transform = snapshot.renderTransform;
+    rigidBody->setLinearVelocity(snapshot.linearVelocity);
+    rigidBody->setAngularVelocity(snapshot.angularVelocity);
+    rigidBody->setInterpolationLinearVelocity(snapshot.interpolationLinearVelocity);
+    rigidBody->setInterpolationAngularVelocity(snapshot.interpolationAngularVelocity);
+    rigidBody->clearForces();
+}
+
+int PhysicsWorld::snapshot(void* dst, int64_t capacity, bool withContacts) const {
+    btDispatcher* dispatcher = ctx->world->getDispatcher();
+    SnapshotHeader header = { SNAPSHOT_VERSION, 0, withContacts ? dispatcher->getNumManifolds() : 0, ctx->tick, ctx->localTime };
+    for (int i = 0; i < ctx->bodies.size(); i++) {
+        if (ctx->bodies[i] != nullptr && !ctx->bodies[i]->isStaticObject()) header.bodies++;
+    }
+    int64_t bytes = sizeof(SnapshotHeader) + header.bodies * sizeof(BodySnapshot) + header.contacts * sizeof(ContactSnapshot);
+    if (bytes > capacity) return (int) -bytes;
+
+    auto* out = (char*) dst;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    BodySnapshot body;
+    for (int i = 0; i < ctx->bodies.size(); i++) {
+        if (ctx->bodies[i] == nullptr || ctx->bodies[i]->isStaticObject()) continue;
+        takeBodySnapshot(ctx->bodies[i], body);
+        memcpy(out, &body, sizeof(body));
+        out += sizeof(body);
+    }
+    ContactSnapshot contact;
+    for (int i = 0; i < header.contacts; i++) {
+        const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+        contact.serialA = manifold->getBody0()->getUserIndex2();
+        contact.serialB = manifold->getBody1()->getUserIndex2();
+        contact.count = manifold->getNumContacts();
+        for (int j = 0; j < contact.count; j++) contact.points[j] = manifold->getContactPoint(j);
+        memcpy(out, &contact, sizeof(contact));
+        out += sizeof(contact);
+    }
+    return (int) bytes;
+}
+
+int PhysicsWorld::restore(const void* src, int64_t length) {
+    auto* in = (const char*) src;
+    SnapshotHeader header;
+    if (length < (int64_t) sizeof(header)) return -1;
+    memcpy(&header, in, sizeof(header));
+    in += sizeof(header);
+    int64_t bytes = sizeof(SnapshotHeader) + header.bodies * sizeof(BodySnapshot) + header.contacts * sizeof(ContactSnapshot);
+    if (header.version != SNAPSHOT_VERSION || bytes > length) return -1;
+
+    int restored = 0;
+    BodySnapshot body;
+    for (int i = 0; i < header.bodies; i++) {
+        memcpy((void*) &body, in, sizeof(body));
+        in += sizeof(body);
+        if (body.index >= ctx->bodies.size() || liveBodyIndex(ctx, body.index, body.serial) < 0) continue;
+        restoreBodySnapshot(ctx, ctx->bodies[body.index], body);
+        restored++;
+    }
+
+    if (header.contacts > 0) {
+        btDispatcher* dispatcher = ctx->world->getDispatcher();
+        btHashMap<ContactPairKey, btPersistentManifold*>& manifolds = ctx->manifoldsByPair;
+        manifolds.clear();
+        for (int i = 0; i < dispatcher->getNumManifolds(); i++) {
+            btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+            ContactPairKey key = { manifold->getBody0()->getUserIndex2(), manifold->getBody1()->getUserIndex2() };
+            if (manifolds.find(key) == nullptr) manifolds.insert(key, manifold);
+        }
+        ContactSnapshot contact;
+        for (int i = 0; i < header.contacts; i++) {
+            memcpy((void*) &contact, in, sizeof(contact));
+            in += sizeof(contact);
+            ContactPairKey key = { contact.serialA, contact.serialB };
+            btPersistentManifold** manifold = manifolds.find(key);
+            if (manifold == nullptr) continue; // not overlapping anymore
+            (*manifold)->clearManifold();
+            for (int j = 0; j < contact.count; j++) (*manifold)->addManifoldPoint(contact.points[j]);
+        }
+    }
+    // the ticks after the snapshot are simulated again, so their hashes and sightings are stale
+    ctx->tick = header.tick;
+    for (int i = 0; i < ctx->stateHashes.size(); i++) {
+        if (ctx->stateHashes[i].tick > header.tick) ctx->stateHashes[i].tick = -1;
+    }
+    for (int i = 0; i < ctx->touchingPairs.size(); i++) {
+        TouchingPair* pair = ctx->touchingPairs.getAtIndex(i);
+        if (pair->lastSeenTick > header.tick) pair->lastSeenTick = header.tick;
+    }
+    ctx->localTime = header.localTime;
+    return restored;
+}
+
+// World checkpoints (see saveCheckpoint) are .bullet files written by btDefaultSerializer: the
+// shape and rigid body chunks bullet writes for a world, plus chunks of our own with what it
+// doesn't know about: body indices, serials and filtering, characters (bullet doesn't serialize
+// ghost objects) and static batch child ids. Loading reads the chunks in place, without the
+// bullet world importer, so checkpoints are only good for the same build (pointer size, bullet version).
+static const int CHECKPOINT_WORLD_CODE = BT_MAKE_ID('S', 'N', 'W', 'W');
+static const int CHECKPOINT_BODIES_CODE = BT_MAKE_ID('S', 'N', 'B', 'D');
+static const int CHECKPOINT_CHILDREN_CODE = BT_MAKE_ID('S', 'N', 'C', 'H');
+
+struct CheckpointWorld {
+    int32_t slots; // body indices in use, including free ones
+    int32_t nextSerial;
+    int32_t tick;
+    float localTime;
+};
+
+struct CheckpointBody {
+    int32_t index;
+    int32_t serial;
+    int32_t ownerSerial; // -1 for none
+    int32_t group, mask;
+    int32_t batchChildren; // child ids of a static batch, next in the children chunk
+    void* rigidBody; // unique pointer of the bullet rigid body chunk, nullptr for characters
+    btVector3 characterPosition;
+    btVector3 characterSize;
+    CharacterMotion characterMotion;
+};
+
+static void serializeCheckpointChunk(btSerializer& serializer, int code, const void* data, int size, int count) {
+    if (count == 0) return;
+    btChunk* chunk = serializer.allocate(size, count);
+    memcpy(chunk->m_oldPtr, data, (size_t) size * count);
+    serializer.finalizeChunk(chunk, "char", code, chunk->m_oldPtr);
+}
+
+// Writes the bodies of the world into a .bullet checkpoint, in the serializer buffer.
+static void serializeCheckpoint(WorldContext* ctx, btDefaultSerializer& serializer) {
+    btSerializer& s = serializer; // findPointer is only public through the interface
+    s.startSerialization();
+    // shapes first, as btCollisionWorld::serialize does. Compounds write their own children
+    for (int i = 0; i < ctx->bodies.size(); i++) {
+        btCollisionObject* body = ctx->bodies[i];
+        if (body == nullptr || asCharacter(body) != nullptr) continue;
+        btCollisionShape* shape = body->getCollisionShape();
+        if (s.findPointer(shape) == nullptr) shape->serializeSingleShape(&s);
+    }
+
+    CheckpointWorld world = { ctx->bodies.size(), ctx->nextSerial, ctx->tick, ctx->localTime };
+    btAlignedObjectArray<CheckpointBody> records;
+    btAlignedObjectArray<int32_t> children;
+    for (int i = 0; i < ctx->bodies.size(); i++) {
+        btCollisionObject* body = ctx->bodies[i];
+        if (body == nullptr) continue;
+        CheckpointBody record;
+        memset((void*) &record, 0, sizeof(record));
+        record.index = i;
+        record.serial = body->getUserIndex2();
+        record.ownerSerial = body->getUserIndex3();
+        record.group = body->getBroadphaseHandle()->m_collisionFilterGroup;
+        record.mask = body->getBroadphaseHandle()->m_collisionFilterMask;
+        Character* character = asCharacter(body);
+        if (character != nullptr) {
+            record.characterPosition = body->getWorldTransform().getOrigin();
+            const ShapeKey& key = ((SharedShape*) body->getCollisionShape()->getUserPointer())->key;
+            record.characterSize = btVector3(key.x, key.y, key.z);
+            character->controller.saveMotion(record.characterMotion);
+        } else {
+            body->serializeSingleObject(&s);
+            record.rigidBody = s.getUniquePointer(body);
+            if (body->getCollisionShape()->isCompound()) {
+                auto* batch = (StaticBatch*) body->getCollisionShape()->getUserPointer();
+                record.batchChildren = batch->childIds.size();
+                for (int j = 0; j < batch->childIds.size(); j++) children.push_back(batch->childIds[j]);
+            }
+        }
+        records.push_back(record);
+    }
+    serializeCheckpointChunk(s, CHECKPOINT_WORLD_CODE, &world, sizeof(world), 1);
+    serializeCheckpointChunk(s, CHECKPOINT_BODIES_CODE, records.size() > 0 ? &records[0] : nullptr, sizeof(CheckpointBody), records.size());
+    serializeCheckpointChunk(s, CHECKPOINT_CHILDREN_CODE, children.size() > 0 ? &children[0] : nullptr, sizeof(int32_t), children.size());
+    s.finishSerialization();
+}
+
+// The chunks of a checkpoint, read in place. Chunks are packed after a 12 byte header, so
+// nothing in them is aligned: every struct is copied out before use.
+struct CheckpointReader {
+    btHashMap<btHashPtr, const unsigned char*> chunksByPointer; // chunk data by unique pointer
+    const unsigned char* world = nullptr;
+    const unsigned char* bodies = nullptr;
+    const unsigned char* children = nullptr;
+    int bodyCount = 0;
+    int childCount = 0;
+
+    // Indexes the chunks of the first length bytes of data. False if it isn't a checkpoint of this build.
+    bool read(const unsigned char* data, int64_t length) {
+        char header[BT_HEADER_LENGTH + 1];
+        snprintf(header, sizeof(header), "BULLETf%cv%d", sizeof(void*) == 8 ? '-' : '_', btGetVersion());
+        if (length < BT_HEADER_LENGTH || memcmp(data, header, BT_HEADER_LENGTH) != 0) return false;
+        int64_t offset = BT_HEADER_LENGTH;
+        while (offset + (int64_t) sizeof(btChunk) <= length) {
+            btChunk chunk;
+            memcpy(&chunk, data + offset, sizeof(chunk));
+            const unsigned char* chunkData = data + offset + sizeof(btChunk);
+            offset += sizeof(btChunk) + chunk.m_length;
+            if (chunk.m_length < 0 || offset > length) return false;
+            if (chunk.m_chunkCode == CHECKPOINT_WORLD_CODE) {
+                world = chunkData;
+            } else if (chunk.m_chunkCode == CHECKPOINT_BODIES_CODE) {
+                bodies = chunkData;
+                bodyCount = chunk.m_number;
+            } else if (chunk.m_chunkCode == CHECKPOINT_CHILDREN_CODE) {
+                children = chunkData;
+                childCount = chunk.m_number;
+            } else {
+                chunksByPointer.insert(chunk.m_oldPtr, chunkData);
+            }
+        }
+        return world != nullptr;
+    }
+
+    // Copies the chunk with the given unique pointer into dst, false if there's no such chunk.
+    template <typename T>
+    bool get(const void* pointer, T& dst) const {
+        const unsigned char* const* found = chunksByPointer.find(pointer);
+        if (found == nullptr) return false;
+        memcpy((void*) &dst, *found, sizeof(T));
+        return true;
+    }
+
+    template <typename T>
+    bool getArray(const void* pointer, int i, T& dst) const {
+        const unsigned char* const* found = chunksByPointer.find(pointer);
+        if (found == nullptr) return false;
+        memcpy((void*) &dst, *found + i * sizeof(T), sizeof(T));
+        return true;
+    }
+};
+
+// Full box size of a serialized btBoxShape: bullet keeps the half extents minus the margin.
+static btVector3 checkpointBoxSize(const btConvexInternalShapeData& data) {
+    btVector3 halfExtents;
+    halfExtents.deSerializeFloat(data.m_implicitShapeDimensions);
+    return (halfExtents + btVector3(data.m_collisionMargin, data.m_collisionMargin, data.m_collisionMargin)) * btScalar(2.0f);
+}
+
+// Rebuilds the shape of a serialized rigid body: a shared box or sphere, or a static batch
+// whose childCount children get the given ids. nullptr for shapes bodies can't have.
+static btCollisionShape* loadCheckpointShape(WorldContext* ctx, const CheckpointReader& reader, const void* pointer,
+        const int32_t* childIds, int childCount) {
+    btCollisionShapeData shape;
+    if (!reader.get(pointer, shape)) return nullptr;
+    if (shape.m_shapeType == BOX_SHAPE_PROXYTYPE || shape.m_shapeType == SPHERE_SHAPE_PROXYTYPE) {
+        btConvexInternalShapeData convex;
+        reader.get(pointer, convex);
+        if (shape.m_shapeType == SPHERE_SHAPE_PROXYTYPE) {
+            return acquireShape(ctx, PHYSICS_TYPE_BULLET, btVector3(convex.m_implicitShapeDimensions.m_floats[0], 0.0f, 0.0f));
+        }
+        return acquireShape(ctx, PHYSICS_TYPE_BOX, checkpointBoxSize(convex));
+    }
+    if (shape.m_shapeType != COMPOUND_SHAPE_PROXYTYPE) return nullptr;
+
+    btCompoundShapeData compound;
+    reader.get(pointer, compound);
+    if (compound.m_numChildShapes != childCount) return nullptr;
+    auto* batch = ctx->staticBatchPool.create();
+    batch->shape.setUserPointer(batch);
+    for (int i = 0; i < compound.m_numChildShapes; i++) {
+        btCompoundShapeChildData child;
+        btConvexInternalShapeData box;
+        if (!reader.getArray(compound.m_childShapePtr, i, child) || !reader.get(child.m_childShape, box)) continue;
+        btTransform transform;
+        transform.deSerializeFloat(child.m_transform);
+        batch->shape.addChildShape(transform, acquireShape(ctx, PHYSICS_TYPE_BOX, checkpointBoxSize(box)));
+        batch->childIds.push_back(childIds[i]);
+    }
+    return &batch->shape;
+}
+
+static btRigidBody* loadCheckpointRigidBody(WorldContext* ctx, const CheckpointReader& reader, const CheckpointBody& record, const int32_t* childIds) {
+    btRigidBodyFloatData data;
+    if (!reader.get(record.rigidBody, data)) return nullptr;
+    const btCollisionObjectFloatData& object = data.m_collisionObjectData;
+    btCollisionShape* shape = loadCheckpointShape(ctx, reader, object.m_collisionShape, childIds, record.batchChildren);
+    if (shape == nullptr) return nullptr;
+
+    btTransform transform;
+    transform.deSerializeFloat(object.m_worldTransform);
+    btScalar mass = data.m_inverseMass != 0.0f ? 1.0f / data.m_inverseMass : 0.0f;
+    btRigidBody* body = createRigidBody(ctx, shape, mass, transform, record.group, record.mask, nullptr);
+    btVector3 linearVelocity, angularVelocity;
+    linearVelocity.deSerializeFloat(data.m_linearVelocity);
+    angularVelocity.deSerializeFloat(data.m_angularVelocity);
+    body->setLinearVelocity(linearVelocity);
+    body->setAngularVelocity(angularVelocity);
+    body->setDamping(data.m_linearDamping, data.m_angularDamping);
+    body->setSleepingThresholds(data.m_linearSleepingThreshold, data.m_angularSleepingThreshold);
+    body->setFriction(object.m_friction);
+    body->setRollingFriction(object.m_rollingFriction);
+    body->setRestitution(object.m_restitution);
+    body->setCcdMotionThreshold(object.m_ccdMotionThreshold);
+    body->setCcdSweptSphereRadius(object.m_ccdSweptSphereRadius);
+    body->forceActivationState(object.m_activationState1);
+    body->setDeactivationTime(object.m_deactivationTime);
+    return body;
+}
+
+// Whether the body records of a checkpoint fit in its slots and children.
+static bool isValidCheckpoint(const CheckpointReader& reader, const CheckpointWorld& world) {
+    if (world.slots < 0) return false;
+    int children = 0;
+    CheckpointBody record;
+    for (int i = 0; i < reader.bodyCount; i++) {
+        memcpy((void*) &record, reader.bodies + i * sizeof(CheckpointBody), sizeof(record));
+        if (record.index < 0 || record.index >= world.slots || record.batchChildren < 0) return false;
+        children += record.batchChildren;
+    }
+    return children <= reader.childCount;
+}
+
+// Replaces every body of the world with those of a valid checkpoint, at the same indices and with
+// the same serials, so references kept across the restart still work. Returns the body slots.
+static int loadCheckpoint(WorldContext* ctx, const CheckpointReader& reader) {
+    CheckpointWorld world;
+    memcpy(&world, reader.world, sizeof(world));
+    resetWorldContext(ctx);
+    ctx->bodies.resize(world.slots, nullptr);
+
+    btAlignedObjectArray<int32_t> childIds;
+    childIds.resize(reader.childCount);
+    if (reader.childCount > 0) memcpy(&childIds[0], reader.children, reader.childCount * sizeof(int32_t));
+    int nextChild = 0;
+
+    CheckpointBody record;
+    for (int i = 0; i < reader.bodyCount; i++) {
+        memcpy((void*) &record, reader.bodies + i * sizeof(CheckpointBody), sizeof(record));
+        // allocBodyIndex takes the last free index and the next serial, so make them the recorded ones
+        ctx->freeIndices.push_back(record.index);
+        ctx->nextSerial = record.serial;
+        const int32_t* batchChildIds = record.batchChildren > 0 ? &childIds[nextChild] : nullptr;
+        nextChild += record.batchChildren;
+        btCollisionObject* body;
+        if (record.rigidBody == nullptr) {
+            body = createBody(ctx, PHYSICS_TYPE_CHARACTER, 0.0f, record.characterPosition, record.characterSize, record.group, record.mask);
+            asCharacter(body)->controller.restoreMotion(record.characterMotion);
+        } else {
+            body = loadCheckpointRigidBody(ctx, reader, record, batchChildIds);
+            if (body == nullptr) {
+                ctx->freeIndices.pop_back();
+                continue;
+            }
+        }
+        body->setUserIndex3(record.ownerSerial);
+        markBodyDirty(ctx, body);
+    }
+
+    ctx->freeIndices.resize(0);
+    for (int i = world.slots - 1; i >= 0; i--) {
+        if (ctx->bodies[i] == nullptr) ctx->freeIndices.push_back(i);
+    }
+    ctx->nextSerial = world.nextSerial;
+    ctx->tick = world.tick;
+    ctx->localTime = world.localTime;
+    return world.slots;
+}
+
+int PhysicsWorld::saveCheckpoint(void* dst, int64_t capacity) const {
+    btDefaultSerializer serializer;
+    serializeCheckpoint(ctx, serializer);
+    int bytes = serializer.getCurrentBufferSize();
+    if (bytes > capacity) return -bytes;
+    memcpy(dst, serializer.getBufferPointer(), bytes);
+    return bytes;
+}
+
+int PhysicsWorld::loadCheckpoint(const void* src, int64_t length, int maxSlots) {
+    CheckpointReader reader;
+    if (!reader.read((const unsigned char*) src, length)) return -1;
+    CheckpointWorld world;
+    memcpy(&world, reader.world, sizeof(world));
+    if (!isValidCheckpoint(reader, world)) return -1;
+    if (world.slots > maxSlots) return -world.slots;
+    return ::loadCheckpoint(ctx, reader);
+}
+
+// Queue of batches of words between exactly one producer and one consumer thread, without locks.
+// Each batch goes in prefixed by its length and is only published once whole, so the consumer
+// never sees one half written. Capacity must be a power of two.
+template <typename T>
+class BatchQueue {
+public:
+    explicit BatchQueue(int capacity) : mask(capacity - 1), head(0), tail(0) {
+        words.resize(capacity);
+    }
+
+    // Producer: false, pushing nothing, if there's no room for the whole batch now.
+    bool push(const T* batch, int length) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+        if ((uint32_t)(length + 1) > (uint32_t) words.size() - (t - h)) return false;
+        words[t & mask] = (T) length;
+        for (int i = 0; i < length; i++) words[(t + 1 + i) & mask] = batch[i];
+        tail.store(t + 1 + length, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: length of the oldest batch, or -1 if there's none.
+    int peekLength() const {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return -1;
+        return (int) words[h & mask];
+    }
+
+    // Consumer: moves the oldest batch (of peekLength words) into dst.
+    void pop(T* dst) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        int length = (int) words[h & mask];
+        for (int i = 0; i < length; i++) dst[i] = words[(h + 1 + i) & mask];
+        head.store(h + 1 + length, std::memory_order_release);
+    }
+
+private:
+    btAlignedObjectArray<T> words;
+    uint32_t mask;
+    std::atomic<uint32_t> head; // next word to read, only written by the consumer
+    std::atomic<uint32_t> tail; // next word to write, only written by the producer
+};
+
+// What the step thread publishes after each fixed step.
+struct StepFrame {
+    int32_t tick;
+    int slots;
+    float stats[PHYSICS_STATS_FLOATS]; // of the fixed step that made it
+    std::chrono::steady_clock::time_point published;
+    btAlignedObjectArray<float> bodyStates; // exportBodyStates layout, with capacity slots
+    btAlignedObjectArray<PhysicsProjectileState> projectiles;
+    btAlignedObjectArray<PhysicsCharacterState> characters;
+};
+
+// Frame index in StepThread::middle, flagged until the reader takes it.
+static const int FRAME_FRESH = 4;
+
+// A thread stepping a world by itself. The owner thread pushes command streams into commands,
+// and takes the results of each back from results, in order. Frames are triple buffered: the
+// step thread writes into back and swaps it with middle, and the reader swaps middle with front
+// when there's a fresh one, so neither waits and the reader always gets the latest whole frame.
+struct StepThread {
+    StepThread() : commands(PHYSICS_STEP_QUEUE_WORDS), results(PHYSICS_STEP_QUEUE_WORDS),
+                   running(true), middle(1), back(2), front(0), frontUnread(false) {
+        for (StepFrame& frame : frames) {
+            frame.tick = 0;
+            frame.slots = 0;
+            for (float& stat : frame.stats) stat = 0.0f;
+            frame.published = std::chrono::steady_clock::now();
+        }
+    }
+
+    BatchQueue<int32_t> commands;
+    BatchQueue<int64_t> results; // [tick applied at, result pairs...] per command stream
+    btAlignedObjectArray<int32_t> commandScratch;
+    btAlignedObjectArray<int64_t> resultScratch;
+    std::atomic<bool> running;
+    StepFrame frames[3];
+    std::atomic<int> middle;
+    int back; // step thread only
+    int front; // reader only
+    bool frontUnread;
+    std::thread thread;
+};
+
+// Applies every queued command stream, passing their results back. Waits for room in results
+// rather than losing any, unless the thread is stopping.
+static void applyQueuedCommands(PhysicsWorld* world, WorldContext* ctx, StepThread* stepThread) {
+    int length;
+    while ((length = stepThread->commands.peekLength()) >= 0) {
+        btAlignedObjectArray<int32_t>& words = stepThread->commandScratch;
+        btAlignedObjectArray<int64_t>& results = stepThread->resultScratch;
+        words.resize(btMax(length, 1));
+        stepThread->commands.pop(&words[0]);
+        int maxResults = length / MIN_RESULT_COMMAND_WORDS + 1;
+        results.resize(1 + maxResults * 2);
+        results[0] = ctx->tick;
+        int count = world->applyCommands(&words[0], length, &results[1], maxResults);
+        while (!stepThread->results.push(&results[0], 1 + count * 2)) {
+            if (!stepThread->running.load(std::memory_order_acquire)) return;
+            std::this_thread::yield();
+        }
+    }
+}
+
+static void publishFrame(PhysicsWorld* world, WorldContext* ctx, StepThread* stepThread) {
+    StepFrame& frame = stepThread->frames[stepThread->back];
+    frame.tick = ctx->tick;
+    frame.slots = ctx->bodies.size();
+    frame.bodyStates.resize(frame.slots * PHYSICS_BODY_STATE_FLOATS);
+    if (frame.slots > 0) world->exportBodyStates(false, &frame.bodyStates[0], frame.slots);
+    frame.projectiles.resize(ctx->projectiles.ids.size());
+    if (frame.projectiles.size() > 0) world->exportProjectiles(&frame.projectiles[0], frame.projectiles.size());
+    frame.characters.resize(ctx->characters.size());
+    if (frame.characters.size() > 0) world->exportCharacterStates(&frame.characters[0], frame.characters.size());
+    world->readStepStats(frame.stats);
+    frame.published = std::chrono::steady_clock::now();
+    stepThread->back = stepThread->middle.exchange(stepThread->back | FRAME_FRESH, std::memory_order_acq_rel) & ~FRAME_FRESH;
+}
+
+void PhysicsWorld::stepThreadLoop() {
+    StepThread* stepThread = ctx->stepThread;
+    auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(ctx->fixedTimeStep));
+    auto next = std::chrono::steady_clock::now();
+    while (stepThread->running.load(std::memory_order_acquire)) {
+        applyQueuedCommands(this, ctx, stepThread);
+        stepWorldTicks(ctx, 1);
+        // nobody reads contact events or projectile hits meanwhile, drop them instead of piling up
+        ctx->contactsRead = ctx->contactsWritten;
+        ctx->projectiles.hits.resize(0);
+        publishFrame(this, ctx, stepThread);
+
+        next += step;
+        auto now = std::chrono::steady_clock::now();
+        // too far behind: drop the time instead of catching up, as simulate does over maxSubSteps
+        if (now - next > step * btMax(ctx->maxSubSteps, 1)) next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+bool PhysicsWorld::startStepThread() {
+    if (ctx->stepThread != nullptr) return false;
+    ctx->localTime = 0.0f; // the step thread only ever steps whole ticks
+    ctx->stepThread = new StepThread();
+    ctx->stepThread->thread = std::thread(&PhysicsWorld::stepThreadLoop, this);
+    return true;
+}
+
+void PhysicsWorld::stopStepThread() {
+    StepThread* stepThread = ctx->stepThread;
+    if (stepThread == nullptr) return;
+    stepThread->running.store(false, std::memory_order_release);
+    stepThread->thread.join();
+    delete stepThread;
+    ctx->stepThread = nullptr;
+}
+
+bool PhysicsWorld::isStepThreadRunning() const {
+    return ctx->stepThread != nullptr;
+}
+
+bool PhysicsWorld::submitCommands(const int32_t* words, int length) {
+    if (ctx->stepThread == nullptr || length < 0) return false;
+    return ctx->stepThread->commands.push(words, length);
+}
+
+int PhysicsWorld::readCommandResults(int64_t* dst, int capacity) {
+    if (ctx->stepThread == nullptr) return 0;
+    BatchQueue<int64_t>& results = ctx->stepThread->results;
+    int written = 0;
+    int length;
+    while ((length = results.peekLength()) >= 0) {
+        int count = (length - 1) / 2;
+        int pairs = 1 + count;
+        if (written + pairs > capacity) return written > 0 ? written : -pairs;
+        int64_t* batch = dst + written * 2;
+        results.pop(batch + 1); // tick, then the results, after the count
+        batch[0] = count;
+        written += pairs;
+    }
+    return written;
+}
+
+int PhysicsWorld::readFrame(PhysicsFrameInfo* info, float* bodyStates, int capacity,
+                            PhysicsProjectileState* projectiles, int projectileCapacity,
+                            PhysicsCharacterState* characters, int characterCapacity) {
+    StepThread* stepThread = ctx->stepThread;
+    if (stepThread == nullptr) return 0;
+    if (stepThread->middle.load(std::memory_order_relaxed) & FRAME_FRESH) {
+        stepThread->front = stepThread->middle.exchange(stepThread->front, std::memory_order_acq_rel) & ~FRAME_FRESH;
+        stepThread->frontUnread = true;
+    }
+    const StepFrame& frame = stepThread->frames[stepThread->front];
+    std::chrono::duration<float> age = std::chrono::steady_clock::now() - frame.published;
+    info->tick = frame.tick;
+    info->slots = frame.slots;
+    info->projectiles = frame.projectiles.size();
+    info->characters = frame.characters.size();
+    info->age = age.count();
+    memcpy(info->stats, frame.stats, sizeof(frame.stats));
+    if (!stepThread->frontUnread) return 0;
+    if (frame.slots > capacity || frame.projectiles.size() > projectileCapacity
+        || frame.characters.size() > characterCapacity) return -1;
+
+    // the frame holds exactly slots, spread them over the arrays of capacity
+    const int arrays[] = { 3, 4, 3, 3 };
+    int from = 0, to = 0;
+    for (int floats : arrays) {
+        if (frame.slots > 0) memcpy(bodyStates + to, &frame.bodyStates[from], frame.slots * floats * sizeof(float));
+        from += frame.slots * floats;
+        to += capacity * floats;
+    }
+    if (frame.projectiles.size() > 0) memcpy(projectiles, &frame.projectiles[0], frame.projectiles.size() * sizeof(PhysicsProjectileState));
+    if (frame.characters.size() > 0) memcpy(characters, &frame.characters[0], frame.characters.size() * sizeof(PhysicsCharacterState));
+    stepThread->frontUnread = false;
+    return 1;
+}
+
+void PhysicsWorld::runSteppingBenchmark(const int32_t* threadCounts, int count, int steps, float* results) {
+    for (int i = 0; i < count; i++) {
+        PhysicsWorld world(newWorldContext(threadCounts[i]));
+        buildArenaScene(world, 1234u, 16, 256);
+        for (int step = 0; step < 10; step++) world.simulate(1.0f / 60.0f); // warm up caches and pairs
+
+        auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; step++) world.simulate(1.0f / 60.0f);
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        results[i] = elapsed.count() / steps;
+        LOGI("stepping benchmark: %d threads (%d used): %.3f ms/step", threadCounts[i], world.ctx->threads, results[i]);
+    }
+}
+
+float PhysicsWorld::runRaycastBenchmark(int rays, int iterations) {
+    if (rays <= 0 || iterations <= 0) return 0.0f;
+    PhysicsWorld world(newWorldContext(1));
+    buildArenaScene(world, 1234u, 16, 256);
+    world.simulate(1.0f / 60.0f); // so the broadphase has every aabb
+
+    SceneRandom random = { 4321u };
+    btAlignedObjectArray<PhysicsRayQuery> queries;
+    btAlignedObjectArray<PhysicsRayHit> hits;
+    queries.resize(rays);
+    hits.resize(rays);
+    for (int i = 0; i < rays; i++) {
+        PhysicsRayQuery& query = queries[i];
+        query.from[0] = random.between(-45, 45);
+        query.from[1] = random.between(1, 4);
+        query.from[2] = random.between(-45, 45);
+        query.to[0] = random.between(-45, 45);
+        query.to[1] = random.between(0, 8);
+        query.to[2] = random.between(-45, 45);
+        query.mask = -1;
+    }
+
+    int hitCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < rays; i++) {
+            if (castRay(world.ctx, queries[i], hits[i])) hitCount++;
+        }
+    }
+    std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    float micros = elapsed.count() / ((float)rays * iterations);
+    LOGI("raycast benchmark: %d rays x %d: %.3f us/ray, %.1f%% hit", rays, iterations, micros,
+         100.0f * hitCount / ((float)rays * iterations));
+    return micros;
+}
+
+float PhysicsWorld::runProjectileBenchmark(int projectiles, int steps) {
+    if (projectiles <= 0 || steps <= 0) return 0.0f;
+    PhysicsWorld world(newWorldContext(1));
+    WorldContext* ctx = world.ctx;
+    buildArenaScene(world, 1234u, 16, 0);
+    world.simulate(1.0f / 60.0f); // so the broadphase has every aabb
+
+    SceneRandom random = { 4321u };
+    for (int i = 0; i < projectiles; i++) {
+        btVector3 pos(random.between(-45, 45), random.between(1, 4), random.between(-45, 45));
+        btVector3 velocity(random.between(-50, 50), random.between(0, 10), random.between(-50, 50));
+        spawnProjectile(ctx, pos, velocity, 0.2f, 15.0f, -1, -1);
+    }
+
+    int64_t projectileSteps = 0;
+    std::chrono::duration<float, std::micro> elapsed(0.0f);
+    for (int step = 0; step < steps && ctx->projectiles.ids.size() > 0; step++) {
+        projectileSteps += ctx->projectiles.ids.size();
+        auto start = std::chrono::steady_clock::now();
+        stepProjectiles(ctx, 1.0f / 60.0f);
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+    float micros = elapsed.count() / (float) btMax(projectileSteps, (int64_t) 1);
+    LOGI("projectile benchmark: %d projectiles, %lld projectile steps: %.3f us/projectile step, %d hits",
+         projectiles, (long long) projectileSteps, micros, ctx->projectiles.hits.size());
+    return micros;
+}
+
+void PhysicsWorld::runBroadphaseBenchmark(int steps, float results[PHYSICS_BROADPHASE_BENCHMARK_FLOATS]) {
+    if (steps <= 0) return;
+    const int kinds[] = { PHYSICS_BROADPHASE_DBVT, PHYSICS_BROADPHASE_SAP, PHYSICS_BROADPHASE_SAP_32 };
+    const char* kindNames[] = { "dbvt", "sap", "sap32" };
+    const int sceneBalls[] = { 1024, 64 };
+    const char* sceneNames[] = { "crowded", "sparse" };
+
+    for (int k = 0; k < 3; k++) {
+        BroadphaseConfig config = { kinds[k], btVector3(-100.0f, -50.0f, -100.0f), btVector3(100.0f, 100.0f, 100.0f) };
+        for (int scene = 0; scene < 2; scene++) {
+            PhysicsWorld world(newWorldContext(1, config));
+            WorldContext* ctx = world.ctx;
+            buildArenaScene(world, 1234u, 16, sceneBalls[scene], true); // balls the broadphase sees
+            for (int step = 0; step < 10; step++) world.simulate(1.0f / 60.0f); // warm up caches and pairs
+
+            resetStepStats(ctx);
+            auto start = std::chrono::steady_clock::now();
+            for (int step = 0; step < steps; step++) world.simulate(1.0f / 60.0f);
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            float* value = &results[(k * 2 + scene) * 3];
+            value[0] = elapsed.count() / steps;
+            value[1] = (float)(ctx->phaseMicros[PHYSICS_PHASE_BROADPHASE] / 1000.0 / steps);
+            value[2] = (float) ctx->world->getPairCache()->getNumOverlappingPairs();
+            LOGI("broadphase benchmark: %s, %s: %.3f ms/step, %.3f ms/step in broadphase, %d pairs",
+                 kindNames[k], sceneNames[scene], value[0], value[1], (int) value[2]);
+        }
+    }
+}
+
+void PhysicsWorld::runSolverBenchmark(const int32_t* solvers, const int32_t* iterations, int count, int steps, float* results) {
+    if (steps <= 0) return;
+    const char* solverNames[] = { "si", "nncg", "dantzig", "lemke", "pgs" };
+    const int stacks = 32, height = 10;
+
+    for (int n = 0; n < count; n++) {
+        PhysicsWorld world(newWorldContext(1, DEFAULT_BROADPHASE, solvers[n]));
+        WorldContext* ctx = world.ctx;
+        setSolverSettings(ctx, iterations[n], true, DEFAULT_WARMSTARTING_FACTOR);
+        ctx->deactivationTime = 0.0f; // settled stacks would sleep, and cost nothing
+        buildCrateStacksScene(world, stacks, height);
+        // crates come right after the ground, at index 1 onwards
+        btAlignedObjectArray<btVector3> stacked;
+        for (int i = 0; i < stacks * height; i++) {
+            stacked.push_back(ctx->bodies[i + 1]->getWorldTransform().getOrigin());
+        }
+
+        resetStepStats(ctx);
+        auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; step++) world.simulate(1.0f / 60.0f);
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        float drift = 0.0f;
+        int fallen = 0;
+        for (int i = 0; i < stacked.size(); i++) {
+            float distance = ctx->bodies[i + 1]->getWorldTransform().getOrigin().distance(stacked[i]);
+            drift += distance;
+            if (distance > 0.5f) fallen++;
+        }
+        float* value = &results[n * PHYSICS_SOLVER_BENCHMARK_FLOATS];
+        value[0] = elapsed.count() / steps;
+        value[1] = (float)(ctx->phaseMicros[PHYSICS_PHASE_SOLVER] / 1000.0 / steps);
+        value[2] = drift / stacked.size();
+        value[3] = (float) fallen / stacked.size();
+        LOGI("solver benchmark: %s, %d iterations: %.3f ms/step, %.3f ms/step in solver, %.4f drift, %.1f%% fallen",
+             solverNames[ctx->solver], (int) ctx->world->getSolverInfo().m_numIterations, value[0], value[1],
+             value[2], 100.0f * value[3]);
+    }
+}
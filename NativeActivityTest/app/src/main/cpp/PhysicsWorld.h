@@ -0,0 +1,185 @@
+// Native physics core: bullet worlds with the bodies, characters and projectiles of the game, and
+// the bulk exports, queries, snapshots and benchmarks the game uses. Independent of any binding;
+// JNI_PhysicsImpl.cpp exposes it to BulletPhysicsNativeImpl through the C API in physics_api.h.
+#ifndef SNOWER_PHYSICS_WORLD_H
+#define SNOWER_PHYSICS_WORLD_H
+
+#include "physics_api.h"
+
+struct WorldContext;
+
+// Handle of a body (a rigid body, or the ghost object of a character) of some PhysicsWorld,
+// valid until the body is deleted. Never defined: it's the bullet collision object itself.
+struct PhysicsBody;
+
+// A world, created and deleted through create and destroy, which pool them. Not thread safe:
+// a world and the bodies in it must be used from one thread at a time.
+class PhysicsWorld {
+public:
+    PhysicsWorld(const PhysicsWorld&) = delete;
+    PhysicsWorld& operator=(const PhysicsWorld&) = delete;
+
+    static PhysicsWorldConfig defaultConfig(); // dbvt, single threaded, bullet sleeping and solver defaults
+    // A world for config, reusing a pooled one with the same threads, broadphase and solver kind if there is one.
+    static PhysicsWorld* create(const PhysicsWorldConfig& config);
+    // Resets the world and pools it if there's room, deletes it otherwise.
+    static void destroy(PhysicsWorld* world);
+    // Fills the world pool up to count worlds (capped at 2), each with room for the given number
+    // of bodies, so the next creates with the same thread count and the dbvt broadphase are instant.
+    static void prewarm(int count, int bodies, int threads);
+    // Removes every body, leaving the world as new but keeping everything allocated.
+    void reset();
+    // Live and pooled (allocated but free) object counts of each world pool, as [live, pooled]
+    // pairs for bodies, motion states, box shapes, sphere shapes, shape registry entries,
+    // characters and static batches.
+    void getPoolStats(int32_t dst[PHYSICS_POOL_COUNT * 2]) const;
+
+    // Stepping: fixed substeps of fixedTimeStep seconds, at most maxSubSteps per simulate.
+    // maxSubSteps 0 steps the world by the given time as is (variable step).
+    void setStepping(float fixedTimeStep, int maxSubSteps);
+    // Advances the world step seconds. Time that doesn't fill a fixed step is carried over to the
+    // next call, and time over the substep budget is dropped. Returns the substeps simulated.
+    int simulate(float step);
+    // How far the interpolated transforms are from the last fixed step to the next, in [0, 1).
+    float interpolationFraction() const;
+    // Lockstep mode: the same commands at the same ticks give the same results, bit by bit, on
+    // the same build, and each tick is hashed. Only for single threaded worlds.
+    void setDeterministic(bool deterministic);
+    // Advances the world exactly ticks fixed steps. Time left over by simulate is dropped.
+    void stepTicks(int ticks);
+    int tick() const; // fixed steps simulated since the world was created or reset
+    int threads() const; // threads stepping the world: config.threads as resolved at creation
+    // The state hash of a deterministic world after the given tick, or 0 if the tick is not
+    // one of the last PHYSICS_STATE_HASH_HISTORY simulated in lockstep mode.
+    int64_t stateHash(int tick) const;
+    // Writes where the time of the world went since the last call: millis in each PHYSICS_PHASE_*,
+    // in stepping overall and fixed steps simulated, and how busy it is now: overlapping pairs,
+    // contact manifolds and contact points (see PHYSICS_STAT_*). Starts over for the next call.
+    void readStepStats(float dst[PHYSICS_STATS_FLOATS]);
+
+    // Creates a body of a PHYSICS_TYPE_* and adds it to the world. It collides with bodies whose
+    // group is in its mask and the other way around; group 0 keeps the bullet default filtering.
+    // Never collides with owner. Characters get a ghost object driven by a character controller.
+    PhysicsBody* createBody(int type, float mass, const float position[3], const float size[3],
+                            int group = 0, int mask = 0, const PhysicsBody* owner = nullptr);
+    // Merges boxes into a single static body, where they get ids 0 to count - 1 as children.
+    // Rays and contacts report the batch body index for any of its boxes. nullptr if count <= 0.
+    PhysicsBody* createStaticBatch(const PhysicsStaticBox* boxes, int count, int group, int mask);
+    void deleteBody(PhysicsBody* body);
+    PhysicsBody* body(int index) const; // nullptr for free slots
+    static int bodyIndex(const PhysicsBody* body); // stable until the body is deleted
+    static void getBodyOpenGLMatrix(const PhysicsBody* body, bool interpolated, float dst[16]);
+    // Position, quaternion, linear and angular velocity at the last fixed step.
+    static void getBodyState(const PhysicsBody* body, float dst[PHYSICS_BODY_STATE_FLOATS]);
+    static void setBodyTransform(PhysicsBody* body, const float position[3], const float rotation[4]);
+    static void setBodyVelocity(PhysicsBody* body, const float linearVelocity[3], const float angularVelocity[3]);
+
+    // Applies the first length words of a PHYSICS_CMD_* stream. For every create and projectile
+    // spawn, in order, writes two int64s into results: the new body handle and index, or 0 and the
+    // projectile id. Stops at the first malformed command. Returns how many results there are.
+    int applyCommands(const int32_t* words, int length, int64_t* results, int resultCapacity);
+    // Writes the state of every dynamic body into dst, laid out as struct-of-arrays with capacity slots:
+    // [positions: 3*capacity][quaternions: 4*capacity][linear: 3*capacity][angular: 3*capacity],
+    // each array indexed by body index. Slots of static or deleted bodies are left untouched.
+    // Returns the number of slots in use. If that's bigger than capacity, nothing is written and
+    // returns -(slots in use).
+    int exportBodyStates(bool interpolated, float* dst, int capacity);
+    // Like exportBodyStates, but only writes the bodies moved by the simulation since the last call,
+    // and their indices into changed. Returns how many bodies were written. If dst or changed can't
+    // hold every slot in use, nothing is written and returns -(slots in use).
+    int exportChangedBodyStates(bool interpolated, float* dst, int capacity, int32_t* changed, int changedCapacity);
+    // Writes into counts how many non-static bodies are in each activation state, and into bits a
+    // bitset of the awake bodies: bit i % 32 of the int i / 32 is set if body i is active. Returns
+    // the slots in use. If bits can't hold a bit per slot, it's left untouched and returns -(slots).
+    int exportActivationStates(int32_t counts[PHYSICS_ACTIVATION_STATE_COUNT], int32_t* bits, int bitsCapacity);
+    // Moves the contact events written since the last call into dst, oldest first. Returns how
+    // many were written; events that don't fit stay for the next call.
+    int readContactEvents(PhysicsContactEvent* dst, int capacity);
+    int64_t droppedContactEvents() const; // lost because they weren't read before the ring filled up
+    // Whether fixed steps scan contacts into events, true for new worlds. Turned off, contacts
+    // cost nothing and nothing fills the ring, for users that never read it.
+    void setContactEvents(bool enabled);
+    // Casts count rays, writing the closest hit of each into hits. Returns how many hit something.
+    int castRays(const PhysicsRayQuery* rays, PhysicsRayHit* hits, int count);
+    // Writes into dst the indices of the bodies of the query mask groups whose bounds overlap the
+    // region, in no particular order. Returns how many were written. If dst can't hold them all,
+    // nothing is written and returns -(bodies in the region). PHYSICS_CMD_RADIAL_IMPULSE pushes them.
+    int queryRegion(const PhysicsRegionQuery& query, int32_t* dst, int capacity);
+    // Writes every live projectile into dst, in no particular order. Returns how many were written.
+    // If dst can't hold them all, nothing is written and returns -(live projectiles).
+    int exportProjectiles(PhysicsProjectileState* dst, int capacity);
+    // Moves the projectile hits since the last call into dst, oldest first. Returns how many were
+    // written; hits that don't fit stay for the next call.
+    int readProjectileHits(PhysicsProjectileHit* dst, int capacity);
+    // Writes the state of every character into dst, in no particular order. Returns how many were
+    // written. If dst can't hold them all, nothing is written and returns -(characters).
+    int exportCharacterStates(PhysicsCharacterState* dst, int capacity);
+
+    // Copies the dynamic state of every non-static body, plus the contact points of every manifold
+    // if withContacts, so restore can rewind the world to this point. Only good for this process.
+    // Returns the bytes written. If dst is too small, nothing is written and returns -(bytes needed).
+    int snapshot(void* dst, int64_t capacity, bool withContacts) const;
+    // Rewinds the world to a snapshot. Bodies deleted since are skipped, and bodies created since are
+    // left as they are. Every restored body is reported as changed by the next exportChangedBodyStates.
+    // The tick goes back to the snapshot's too, forgetting the state hashes of later ticks.
+    // Returns how many bodies were restored, or -1 if src isn't a snapshot.
+    int restore(const void* src, int64_t length);
+    // Saves every body as a .bullet checkpoint into dst. Returns the bytes written, or -(bytes needed)
+    // without writing anything if dst is too small. Projectiles and contact tracking aren't saved.
+    int saveCheckpoint(void* dst, int64_t capacity) const;
+    // Replaces every body with those of a checkpoint (src is only read, a memory mapped file is
+    // fine), at the same indices. Returns the body slots, -(slots) without loading anything if
+    // they're more than maxSlots, or -1 (leaving the world as it was) if src isn't a checkpoint
+    // of this build.
+    int loadCheckpoint(const void* src, int64_t length, int maxSlots);
+
+    // Stepping on a thread of its own: from startStepThread to stopStepThread (or reset or destroy)
+    // a native thread owns the world, and advances it a fixed step at a time at the rate of the fixed
+    // step. Meanwhile only the calls below may be made, all from a single other thread. Contact
+    // events and projectile hits of those steps are dropped. False if it was running already.
+    bool startStepThread();
+    void stopStepThread(); // waits for the step in progress, if any
+    bool isStepThreadRunning() const;
+    // Queues a PHYSICS_CMD_* stream, applied as a whole before the next fixed step. Bodies created
+    // in earlier streams may only be referred to once their results are read. False, queueing
+    // nothing, if the queue can't hold the stream now (it never holds more than
+    // PHYSICS_STEP_QUEUE_WORDS - 1 words) or the thread isn't running.
+    bool submitCommands(const int32_t* words, int length);
+    // Moves the results of applied streams into dst, oldest first, as int64 pairs: a header of
+    // result count and tick applied at, then the results of applyCommands. Returns the pairs written;
+    // streams that don't fit stay for the next call, and if not even one fits returns -(its pairs).
+    int readCommandResults(int64_t* dst, int capacity);
+    // Reads the latest frame published by the step thread, without waiting for it: body states in
+    // the exportBodyStates layout (not interpolated, with capacity slots), live projectiles and
+    // characters, and into info what else it knows. Returns 1 if it's a frame not read before, 0
+    // (writing only info) if not, or -1 (also only info, so buffers can grow) if something doesn't fit.
+    int readFrame(PhysicsFrameInfo* info, float* bodyStates, int capacity,
+                  PhysicsProjectileState* projectiles, int projectileCapacity,
+                  PhysicsCharacterState* characters, int characterCapacity);
+
+    // Steps the arena scene (16 players, 256 balls as projectiles) with each of the given thread counts,
+    // writing the average milliseconds per step of each into results.
+    static void runSteppingBenchmark(const int32_t* threadCounts, int count, int steps, float* results);
+    // Average microseconds per ray of batches of random rays against the arena scene.
+    static float runRaycastBenchmark(int rays, int iterations);
+    // Average microseconds per projectile and step of projectiles fired across the arena scene.
+    static float runProjectileBenchmark(int projectiles, int steps);
+    // Steps a crowded (16 players, 1024 balls) and a sparse (16 players, 64 balls) arena scene with
+    // each broadphase kind, balls being rigid bodies so the broadphase has them. Writes, for each kind and then scene: average milliseconds per step,
+    // milliseconds of those in the broadphase, and overlapping pairs at the end.
+    static void runBroadphaseBenchmark(int steps, float results[PHYSICS_BROADPHASE_BENCHMARK_FLOATS]);
+    // Steps 32 stacks of 10 crates, never sleeping, with each solver kind and iteration count pair.
+    // Writes for each: average milliseconds per step, milliseconds of those in the solver, how far
+    // crates ended up from where they were stacked on average, and the fraction of them that fell
+    // (moved over half their size).
+    static void runSolverBenchmark(const int32_t* solvers, const int32_t* iterations, int count, int steps, float* results);
+
+private:
+    explicit PhysicsWorld(WorldContext* ctx) : ctx(ctx) {}
+    ~PhysicsWorld();
+    void stepThreadLoop();
+
+    WorldContext* ctx;
+};
+
+#endif // SNOWER_PHYSICS_WORLD_H
@@ -0,0 +1,215 @@
+// C API of PhysicsWorld, see physics_api.h.
+#include "physics_api.h"
+#include "PhysicsWorld.h"
+
+extern "C" {
+
+int physics_api_version(void) {
+    return PHYSICS_API_VERSION;
+}
+
+void physics_default_world_config(PhysicsWorldConfig* config) {
+    *config = PhysicsWorld::defaultConfig();
+}
+
+PhysicsWorld* physics_create_world(const PhysicsWorldConfig* config) {
+    return PhysicsWorld::create(*config);
+}
+
+void physics_delete_world(PhysicsWorld* world) {
+    PhysicsWorld::destroy(world);
+}
+
+void physics_prewarm_worlds(int count, int bodies, int threads) {
+    PhysicsWorld::prewarm(count, bodies, threads);
+}
+
+void physics_reset_world(PhysicsWorld* world) {
+    world->reset();
+}
+
+void physics_get_pool_stats(const PhysicsWorld* world, int32_t* dst) {
+    world->getPoolStats(dst);
+}
+
+void physics_set_stepping(PhysicsWorld* world, float fixedTimeStep, int maxSubSteps) {
+    world->setStepping(fixedTimeStep, maxSubSteps);
+}
+
+int physics_simulate(PhysicsWorld* world, float step) {
+    return world->simulate(step);
+}
+
+float physics_get_interpolation_fraction(const PhysicsWorld* world) {
+    return world->interpolationFraction();
+}
+
+void physics_set_deterministic(PhysicsWorld* world, int deterministic) {
+    world->setDeterministic(deterministic != 0);
+}
+
+void physics_step_ticks(PhysicsWorld* world, int ticks) {
+    world->stepTicks(ticks);
+}
+
+int physics_get_tick(const PhysicsWorld* world) {
+    return world->tick();
+}
+
+int64_t physics_get_state_hash(const PhysicsWorld* world, int tick) {
+    return world->stateHash(tick);
+}
+
+void physics_read_step_stats(PhysicsWorld* world, float* dst) {
+    world->readStepStats(dst);
+}
+
+PhysicsBody* physics_create_body(PhysicsWorld* world, int type, float mass, const float* position, const float* size,
+                                 int group, int mask, const PhysicsBody* owner) {
+    return world->createBody(type, mass, position, size, group, mask, owner);
+}
+
+PhysicsBody* physics_create_static_batch(PhysicsWorld* world, const PhysicsStaticBox* boxes, int count, int group, int mask) {
+    return world->createStaticBatch(boxes, count, group, mask);
+}
+
+void physics_delete_body(PhysicsWorld* world, PhysicsBody* body) {
+    world->deleteBody(body);
+}
+
+PhysicsBody* physics_get_body(const PhysicsWorld* world, int index) {
+    return world->body(index);
+}
+
+int physics_get_body_index(const PhysicsBody* body) {
+    return PhysicsWorld::bodyIndex(body);
+}
+
+void physics_get_body_opengl_matrix(const PhysicsBody* body, int interpolated, float* dst) {
+    PhysicsWorld::getBodyOpenGLMatrix(body, interpolated != 0, dst);
+}
+
+void physics_get_body_state(const PhysicsBody* body, float* dst) {
+    PhysicsWorld::getBodyState(body, dst);
+}
+
+void physics_set_body_transform(PhysicsBody* body, const float* position, const float* rotation) {
+    PhysicsWorld::setBodyTransform(body, position, rotation);
+}
+
+void physics_set_body_velocity(PhysicsBody* body, const float* linearVelocity, const float* angularVelocity) {
+    PhysicsWorld::setBodyVelocity(body, linearVelocity, angularVelocity);
+}
+
+int physics_apply_commands(PhysicsWorld* world, const int32_t* words, int length, int64_t* results, int resultCapacity) {
+    return world->applyCommands(words, length, results, resultCapacity);
+}
+
+int physics_export_body_states(PhysicsWorld* world, int interpolated, float* dst, int capacity) {
+    return world->exportBodyStates(interpolated != 0, dst, capacity);
+}
+
+int physics_export_changed_body_states(PhysicsWorld* world, int interpolated, float* dst, int capacity,
+                                       int32_t* changed, int changedCapacity) {
+    return world->exportChangedBodyStates(interpolated != 0, dst, capacity, changed, changedCapacity);
+}
+
+int physics_export_activation_states(PhysicsWorld* world, int32_t* counts, int32_t* bits, int bitsCapacity) {
+    return world->exportActivationStates(counts, bits, bitsCapacity);
+}
+
+int physics_read_contact_events(PhysicsWorld* world, PhysicsContactEvent* dst, int capacity) {
+    return world->readContactEvents(dst, capacity);
+}
+
+int64_t physics_get_dropped_contact_events(const PhysicsWorld* world) {
+    return world->droppedContactEvents();
+}
+
+void physics_set_contact_events(PhysicsWorld* world, int enabled) {
+    world->setContactEvents(enabled != 0);
+}
+
+int physics_cast_rays(PhysicsWorld* world, const PhysicsRayQuery* rays, PhysicsRayHit* hits, int count) {
+    return world->castRays(rays, hits, count);
+}
+
+int physics_query_region(PhysicsWorld* world, const PhysicsRegionQuery* query, int32_t* dst, int capacity) {
+    return world->queryRegion(*query, dst, capacity);
+}
+
+int physics_export_projectiles(PhysicsWorld* world, PhysicsProjectileState* dst, int capacity) {
+    return world->exportProjectiles(dst, capacity);
+}
+
+int physics_read_projectile_hits(PhysicsWorld* world, PhysicsProjectileHit* dst, int capacity) {
+    return world->readProjectileHits(dst, capacity);
+}
+
+int physics_export_character_states(PhysicsWorld* world, PhysicsCharacterState* dst, int capacity) {
+    return world->exportCharacterStates(dst, capacity);
+}
+
+int physics_snapshot_world(const PhysicsWorld* world, void* dst, int64_t capacity, int withContacts) {
+    return world->snapshot(dst, capacity, withContacts != 0);
+}
+
+int physics_restore_world(PhysicsWorld* world, const void* src, int64_t length) {
+    return world->restore(src, length);
+}
+
+int physics_save_checkpoint(const PhysicsWorld* world, void* dst, int64_t capacity) {
+    return world->saveCheckpoint(dst, capacity);
+}
+
+int physics_load_checkpoint(PhysicsWorld* world, const void* src, int64_t length, int maxSlots) {
+    return world->loadCheckpoint(src, length, maxSlots);
+}
+
+int physics_start_step_thread(PhysicsWorld* world) {
+    return world->startStepThread() ? 1 : 0;
+}
+
+void physics_stop_step_thread(PhysicsWorld* world) {
+    world->stopStepThread();
+}
+
+int physics_is_step_thread_running(const PhysicsWorld* world) {
+    return world->isStepThreadRunning() ? 1 : 0;
+}
+
+int physics_submit_commands(PhysicsWorld* world, const int32_t* words, int length) {
+    return world->submitCommands(words, length) ? 1 : 0;
+}
+
+int physics_read_command_results(PhysicsWorld* world, int64_t* dst, int capacity) {
+    return world->readCommandResults(dst, capacity);
+}
+
+int physics_read_frame(PhysicsWorld* world, PhysicsFrameInfo* info, float* bodyStates, int capacity,
+                       PhysicsProjectileState* projectiles, int projectileCapacity,
+                       PhysicsCharacterState* characters, int characterCapacity) {
+    return world->readFrame(info, bodyStates, capacity, projectiles, projectileCapacity, characters, characterCapacity);
+}
+
+void physics_run_stepping_benchmark(const int32_t* threadCounts, int count, int steps, float* results) {
+    PhysicsWorld::runSteppingBenchmark(threadCounts, count, steps, results);
+}
+
+float physics_run_raycast_benchmark(int rays, int iterations) {
+    return PhysicsWorld::runRaycastBenchmark(rays, iterations);
+}
+
+float physics_run_projectile_benchmark(int projectiles, int steps) {
+    return PhysicsWorld::runProjectileBenchmark(projectiles, steps);
+}
+
+void physics_run_broadphase_benchmark(int steps, float* results) {
+    PhysicsWorld::runBroadphaseBenchmark(steps, results);
+}
+
+void physics_run_solver_benchmark(const int32_t* solvers, const int32_t* iterations, int count, int steps, float* results) {
+    PhysicsWorld::runSolverBenchmark(solvers, iterations, count, steps, results);
+}
+
+}
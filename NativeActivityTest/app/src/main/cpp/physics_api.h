@@ -0,0 +1,280 @@
+// C API of the native physics core (PhysicsWorld.h), for bindings other than C++: the JNI shims in
+// JNI_PhysicsImpl.cpp, and anything else that can call C (i.e. a desktop JVM through JNI or JNA).
+// Only plain C types cross it, so bindings don't need the bullet headers.
+//
+// Records written into caller buffers have the layouts documented here, in native byte order;
+// BulletPhysicsNativeImpl reads them at these offsets. Bump PHYSICS_API_VERSION on any change
+// to a function, constant or record.
+#ifndef SNOWER_PHYSICS_API_H
+#define SNOWER_PHYSICS_API_H
+
+#include <stdint.h>
+
+#define PHYSICS_API_VERSION 5
+
+#ifdef __cplusplus
+class PhysicsWorld;
+struct PhysicsBody;
+extern "C" {
+#else
+typedef struct PhysicsWorld PhysicsWorld;
+typedef struct PhysicsBody PhysicsBody;
+#endif
+
+// Body types, as TYPE_* in BulletPhysicsNativeImpl.
+enum {
+    PHYSICS_TYPE_BOX = 0,
+    PHYSICS_TYPE_CHARACTER = 1,
+    PHYSICS_TYPE_BULLET = 2,
+};
+
+// Broadphase kinds, as BROADPHASE_* in BulletPhysicsNativeImpl.
+enum {
+    PHYSICS_BROADPHASE_DBVT = 0, // dynamic aabb trees, unbounded
+    PHYSICS_BROADPHASE_SAP = 1, // btAxisSweep3: sweep and prune within bounds, 16 bit
+    PHYSICS_BROADPHASE_SAP_32 = 2, // bt32BitAxisSweep3: same, with finer 32 bit quantization
+};
+
+// Constraint solver kinds, as SOLVER_* in BulletPhysicsNativeImpl.
+enum {
+    PHYSICS_SOLVER_SI = 0, // btSequentialImpulseConstraintSolver, bullet's default
+    PHYSICS_SOLVER_NNCG = 1, // btNNCGConstraintSolver: conjugate gradient, converges in fewer iterations
+    PHYSICS_SOLVER_MLCP_DANTZIG = 2, // btMLCPSolver solving each island exactly, expensive for big islands
+    PHYSICS_SOLVER_MLCP_LEMKE = 3, // btMLCPSolver with Lemke's algorithm
+    PHYSICS_SOLVER_MLCP_PGS = 4, // btMLCPSolver with projected gauss seidel over the whole island matrix
+    PHYSICS_SOLVER_COUNT = 5,
+};
+
+// Phases the time of a world goes to, as PHASE_* in BulletPhysicsNativeImpl.
+enum {
+    PHYSICS_PHASE_BROADPHASE = 0, // updating aabbs and finding overlapping pairs
+    PHYSICS_PHASE_NARROWPHASE = 1, // contact points of overlapping pairs
+    PHYSICS_PHASE_ISLANDS = 2, // building simulation islands and updating activation
+    PHYSICS_PHASE_SOLVER = 3,
+    PHYSICS_PHASE_INTEGRATION = 4, // predicting and integrating motion, syncing motion states
+    PHYSICS_PHASE_CHARACTERS = 5, // character controllers, which are world actions
+    PHYSICS_PHASE_TICK = 6, // our fixed step callback: contact events, projectiles, hashes
+    PHYSICS_PHASE_SYNC = 7, // our commands, exports and queries from the caller
+    PHYSICS_PHASE_COUNT = 8,
+};
+
+// Layout of physics_read_step_stats: millis in each phase, then these.
+enum {
+    PHYSICS_STAT_STEP_MILLIS = PHYSICS_PHASE_COUNT, // all of stepSimulation, bullet phases and ticks included
+    PHYSICS_STAT_STEPS = PHYSICS_PHASE_COUNT + 1,
+    PHYSICS_STAT_PAIRS = PHYSICS_PHASE_COUNT + 2,
+    PHYSICS_STAT_MANIFOLDS = PHYSICS_PHASE_COUNT + 3,
+    PHYSICS_STAT_CONTACTS = PHYSICS_PHASE_COUNT + 4,
+    PHYSICS_STATS_FLOATS = PHYSICS_PHASE_COUNT + 5,
+};
+
+// Opcodes for the physics_apply_commands stream. Every command is a sequence of 4-byte words:
+// the opcode followed by its arguments (ints or floats). A body reference (ref) is a body index
+// if >= 0, -(n + 1) to refer to the n-th body created earlier in the same stream, or PHYSICS_NO_BODY_REF.
+enum {
+    PHYSICS_CMD_SET_TRANSFORM = 0, // ref, x, y, z, qx, qy, qz, qw
+    PHYSICS_CMD_SET_VELOCITY = 1, // ref, linearX, linearY, linearZ, angularX, angularY, angularZ
+    PHYSICS_CMD_APPLY_IMPULSE = 2, // ref, impulseX, impulseY, impulseZ, relPosX, relPosY, relPosZ
+    PHYSICS_CMD_CREATE = 3, // type, mass, x, y, z, sx, sy, sz, group, mask, ownerRef
+    PHYSICS_CMD_DESTROY = 4, // ref
+    PHYSICS_CMD_SPAWN_PROJECTILE = 5, // x, y, z, vx, vy, vz, radius, lifetime, ownerRef, mask
+    PHYSICS_CMD_REMOVE_PROJECTILE = 6, // id
+    PHYSICS_CMD_MOVE_CHARACTER = 7, // ref, walkX, walkY, walkZ, jumpSpeed
+    PHYSICS_CMD_REMOVE_BATCH_CHILD = 8, // ref, child
+    PHYSICS_CMD_RADIAL_IMPULSE = 9, // x, y, z, radius, impulse, mask (pushes bodies away from x, y, z)
+};
+
+// Body reference that refers to no body (i.e. ownerRef of bodies without owner).
+#define PHYSICS_NO_BODY_REF 0x7fffffff
+
+// Floats per body in physics_export_body_states: position, quaternion, linear and angular velocity.
+#define PHYSICS_BODY_STATE_FLOATS 13
+
+// Pools in physics_get_pool_stats, as POOL_* in BulletPhysicsNativeImpl.
+#define PHYSICS_POOL_COUNT 7
+
+// Activation states counted by physics_export_activation_states, as bullet's (ACTIVE_TAG...) minus one.
+#define PHYSICS_ACTIVATION_STATE_COUNT 5
+
+// Tick hashes kept by deterministic worlds, so a desync can be found a few seconds later.
+#define PHYSICS_STATE_HASH_HISTORY 256
+
+// Floats written by physics_run_broadphase_benchmark: 3 per broadphase kind and scene.
+#define PHYSICS_BROADPHASE_BENCHMARK_FLOATS 18
+
+// Floats written by physics_run_solver_benchmark for each solver configuration.
+#define PHYSICS_SOLVER_BENCHMARK_FLOATS 4
+
+// Words the command queue of a step thread holds, and int64s its result queue holds.
+#define PHYSICS_STEP_QUEUE_WORDS (1 << 17)
+
+enum {
+    PHYSICS_CONTACT_BEGIN = 0,
+    PHYSICS_CONTACT_PERSIST = 1,
+    PHYSICS_CONTACT_END = 2,
+};
+
+// Contact between two bodies (10 4-byte words). point is on body B, and normal points from B
+// to A. Body indices are -1 for bodies deleted before the contact ended.
+typedef struct PhysicsContactEvent {
+    int32_t bodyA;
+    int32_t bodyB;
+    float point[3];
+    float normal[3];
+    float impulse; // total applied impulse of the contact points in the last step
+    int32_t kind; // PHYSICS_CONTACT_*
+} PhysicsContactEvent;
+
+// Where a projectile ended (8 4-byte words). body is the index of the body hit, or -1 if the
+// projectile ran out of lifetime (then point is where it was and normal is zero).
+typedef struct PhysicsProjectileHit {
+    int32_t id;
+    int32_t body;
+    float point[3];
+    float normal[3];
+} PhysicsProjectileHit;
+
+// Live projectile (7 4-byte words).
+typedef struct PhysicsProjectileState {
+    int32_t id;
+    float position[3]; // at the last fixed step
+    float velocity[3];
+} PhysicsProjectileState;
+
+// Character state (2 4-byte words).
+typedef struct PhysicsCharacterState {
+    int32_t body;
+    int32_t onGround; // 1 if standing on something, as the controller sees it
+} PhysicsCharacterState;
+
+// Static box for physics_create_static_batch (10 4-byte words).
+typedef struct PhysicsStaticBox {
+    float position[3];
+    float size[3];
+    float rotation[4]; // quaternion x, y, z, w
+} PhysicsStaticBox;
+
+// Ray for physics_cast_rays (7 4-byte words): from and to in world space, and the collision groups it hits.
+typedef struct PhysicsRayQuery {
+    float from[3];
+    float to[3];
+    int32_t mask;
+} PhysicsRayQuery;
+
+// Closest hit of a PhysicsRayQuery (8 4-byte words). body is -1 and the rest zeros if the ray hit nothing.
+typedef struct PhysicsRayHit {
+    int32_t body;
+    float point[3];
+    float normal[3];
+    float fraction; // of the way from from to to
+} PhysicsRayHit;
+
+// Region for physics_query_region (8 4-byte words): a box of size around center, or a sphere if
+// radius > 0, and the collision groups to report.
+typedef struct PhysicsRegionQuery {
+    float center[3];
+    float size[3]; // full size of the box, as for bodies; ignored for spheres
+    float radius;
+    int32_t mask;
+} PhysicsRegionQuery;
+
+// Frame published by a step thread (18 4-byte words), as physics_read_frame finds it.
+typedef struct PhysicsFrameInfo {
+    int32_t tick; // fixed steps simulated when it was published
+    int32_t slots; // body slots in its body states
+    int32_t projectiles;
+    int32_t characters;
+    float age; // seconds since it was published
+    float stats[PHYSICS_STATS_FLOATS]; // as physics_read_step_stats, for the fixed step that made it
+} PhysicsFrameInfo;
+
+// How a world is created. Sweep and prune broadphases quantize aabbs within boundsMin and
+// boundsMax: bodies can leave them, but get slow to track and pair. Sleeping thresholds
+// apply to bodies created from then on; deactivationTime 0 never sleeps. Each of the
+// solverIterations costs about the same, so stacks that settle with fewer are cheaper.
+typedef struct PhysicsWorldConfig {
+    int32_t threads; // > 1 steps islands in parallel, if bullet has thread support
+    int32_t broadphase; // PHYSICS_BROADPHASE_*
+    float boundsMin[3];
+    float boundsMax[3];
+    float linearSleepThreshold;
+    float angularSleepThreshold;
+    float deactivationTime;
+    int32_t solver; // PHYSICS_SOLVER_*
+    int32_t solverIterations;
+    int32_t simdSolver; // SOLVER_SIMD: solve contact rows with SIMD where bullet was built with it
+    float warmstartingFactor; // of the last step's impulses each contact starts from, 0 for none
+} PhysicsWorldConfig;
+
+// See the PhysicsWorld members of the same name for what every function does.
+// Booleans are ints, 0 for false. Capacities count records (or floats, ints), not bytes.
+
+int physics_api_version(void); // PHYSICS_API_VERSION of the library, for bindings to check
+
+void physics_default_world_config(PhysicsWorldConfig* config);
+PhysicsWorld* physics_create_world(const PhysicsWorldConfig* config);
+void physics_delete_world(PhysicsWorld* world);
+void physics_prewarm_worlds(int count, int bodies, int threads);
+void physics_reset_world(PhysicsWorld* world);
+void physics_get_pool_stats(const PhysicsWorld* world, int32_t* dst); // 2 * PHYSICS_POOL_COUNT
+
+void physics_set_stepping(PhysicsWorld* world, float fixedTimeStep, int maxSubSteps);
+int physics_simulate(PhysicsWorld* world, float step);
+float physics_get_interpolation_fraction(const PhysicsWorld* world);
+void physics_set_deterministic(PhysicsWorld* world, int deterministic);
+void physics_step_ticks(PhysicsWorld* world, int ticks);
+int physics_get_tick(const PhysicsWorld* world);
+int64_t physics_get_state_hash(const PhysicsWorld* world, int tick);
+void physics_read_step_stats(PhysicsWorld* world, float* dst); // PHYSICS_STATS_FLOATS
+
+PhysicsBody* physics_create_body(PhysicsWorld* world, int type, float mass, const float* position, const float* size,
+                                 int group, int mask, const PhysicsBody* owner);
+PhysicsBody* physics_create_static_batch(PhysicsWorld* world, const PhysicsStaticBox* boxes, int count, int group, int mask);
+void physics_delete_body(PhysicsWorld* world, PhysicsBody* body);
+PhysicsBody* physics_get_body(const PhysicsWorld* world, int index);
+int physics_get_body_index(const PhysicsBody* body);
+void physics_get_body_opengl_matrix(const PhysicsBody* body, int interpolated, float* dst); // 16 floats
+void physics_get_body_state(const PhysicsBody* body, float* dst); // PHYSICS_BODY_STATE_FLOATS
+void physics_set_body_transform(PhysicsBody* body, const float* position, const float* rotation);
+void physics_set_body_velocity(PhysicsBody* body, const float* linearVelocity, const float* angularVelocity);
+
+int physics_apply_commands(PhysicsWorld* world, const int32_t* words, int length, int64_t* results, int resultCapacity);
+int physics_export_body_states(PhysicsWorld* world, int interpolated, float* dst, int capacity);
+int physics_export_changed_body_states(PhysicsWorld* world, int interpolated, float* dst, int capacity,
+                                       int32_t* changed, int changedCapacity);
+int physics_export_activation_states(PhysicsWorld* world, int32_t* counts, int32_t* bits, int bitsCapacity);
+int physics_read_contact_events(PhysicsWorld* world, PhysicsContactEvent* dst, int capacity);
+int64_t physics_get_dropped_contact_events(const PhysicsWorld* world);
+void physics_set_contact_events(PhysicsWorld* world, int enabled);
+int physics_cast_rays(PhysicsWorld* world, const PhysicsRayQuery* rays, PhysicsRayHit* hits, int count);
+int physics_query_region(PhysicsWorld* world, const PhysicsRegionQuery* query, int32_t* dst, int capacity);
+int physics_export_projectiles(PhysicsWorld* world, PhysicsProjectileState* dst, int capacity);
+int physics_read_projectile_hits(PhysicsWorld* world, PhysicsProjectileHit* dst, int capacity);
+int physics_export_character_states(PhysicsWorld* world, PhysicsCharacterState* dst, int capacity);
+
+int physics_snapshot_world(const PhysicsWorld* world, void* dst, int64_t capacity, int withContacts);
+int physics_restore_world(PhysicsWorld* world, const void* src, int64_t length);
+int physics_save_checkpoint(const PhysicsWorld* world, void* dst, int64_t capacity);
+int physics_load_checkpoint(PhysicsWorld* world, const void* src, int64_t length, int maxSlots);
+
+int physics_start_step_thread(PhysicsWorld* world);
+void physics_stop_step_thread(PhysicsWorld* world);
+int physics_is_step_thread_running(const PhysicsWorld* world);
+int physics_submit_commands(PhysicsWorld* world, const int32_t* words, int length);
+int physics_read_command_results(PhysicsWorld* world, int64_t* dst, int capacity); // capacity in int64 pairs
+int physics_read_frame(PhysicsWorld* world, PhysicsFrameInfo* info, float* bodyStates, int capacity,
+                       PhysicsProjectileState* projectiles, int projectileCapacity,
+                       PhysicsCharacterState* characters, int characterCapacity);
+
+void physics_run_stepping_benchmark(const int32_t* threadCounts, int count, int steps, float* results);
+float physics_run_raycast_benchmark(int rays, int iterations);
+float physics_run_projectile_benchmark(int projectiles, int steps);
+void physics_run_broadphase_benchmark(int steps, float* results); // PHYSICS_BROADPHASE_BENCHMARK_FLOATS
+void physics_run_solver_benchmark(const int32_t* solvers, const int32_t* iterations, int count, int steps,
+                                  float* results); // count * PHYSICS_SOLVER_BENCHMARK_FLOATS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SNOWER_PHYSICS_API_H
@@ -0,0 +1,275 @@
+// Desktop benchmark of the native physics core. Steps reproducible scenes through the same
+// PhysicsWorld API the app binds to (commands in, states out) and prints one JSON line per scene:
+// step latency percentiles, allocations and memory. Built by CMakeLists.txt when not building for
+// android, against a desktop build of the bullet version in include/bullet.
+//
+// usage: physics-bench [--steps n] [--threads n] [--solver kind] [--iterations n] [scene...]
+//   scenes: arena, crate-pile, crate-stacks, firefight; solvers: si, nncg, dantzig, lemke, pgs
+
+#include "PhysicsWorld.h"
+#include "physics_scenes.h"
+#include "LinearMath/btAlignedAllocator.h"
+#include "LinearMath/btAlignedObjectArray.h"
+#include "LinearMath/btVector3.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Every allocation, through operator new or bullet's btAlignedAlloc.
+static std::atomic<long long> allocations(0);
+static std::atomic<long long> allocatedBytes(0);
+
+static void* countedMalloc(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    return malloc(size);
+}
+
+void* operator new(size_t size) {
+    void* memory = countedMalloc(size);
+    if (memory == nullptr) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+static void* bulletAlloc(size_t size) { return countedMalloc(size); }
+static void bulletFree(void* memory) { free(memory); }
+
+static long residentKilobytes() {
+    long pages = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr) return 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long peakResidentKilobytes() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on linux
+}
+
+static const float STEP = 1.0f / 60.0f;
+static const int WARMUP_STEPS = 60;
+
+// What a scene knows of its world, as the game would: handles of the players, and the command
+// stream of the frame being built.
+struct SceneState {
+    PhysicsWorld* world;
+    btAlignedObjectArray<PhysicsBody*> players;
+    btAlignedObjectArray<int32_t> commands;
+    btAlignedObjectArray<int64_t> results;
+    btAlignedObjectArray<PhysicsProjectileHit> hits;
+
+    void pushFloat(float value) {
+        int32_t word;
+        memcpy(&word, &value, sizeof(word));
+        commands.push_back(word);
+    }
+};
+
+// A scene: built once, then advanced a step at a time. Anything the game would do every frame
+// (moving players, shooting) goes in frame, and is timed with the step.
+struct Scene {
+    const char* name;
+    void (*build)(SceneState& state, SceneRandom& random);
+    void (*frame)(SceneState& state, SceneRandom& random, int step);
+};
+
+// Server.generateWorld: ground, 4 walls, random walls and 21 falling crates.
+static void buildArena(SceneState& state, SceneRandom& random) {
+    buildArenaScene(*state.world, random.state, 0, 0);
+}
+
+// 2000 crates dropped in a 20x20 column over the arena ground, settling into a pile.
+static void buildCratePile(SceneState& state, SceneRandom& random) {
+    const float ground[3] = { 0.0f, 0.0f, 0.0f };
+    const float groundSize[3] = { 100.0f, 1.0f, 100.0f };
+    const float crate[3] = { 1.0f, 1.0f, 1.0f };
+    state.world->createBody(PHYSICS_TYPE_BOX, 0.0f, ground, groundSize);
+    for (int i = 0; i < 2000; i++) {
+        int layer = i / 400, row = i / 20 % 20, column = i % 20;
+        float jitterX = random.between(-10, 10) * 0.01f;
+        float jitterZ = random.between(-10, 10) * 0.01f;
+        float pos[3] = { column * 1.1f - 10.0f + jitterX, 2.0f + layer * 1.5f, row * 1.1f - 10.0f + jitterZ };
+        state.world->createBody(PHYSICS_TYPE_BOX, 3.0f, pos, crate);
+    }
+}
+
+// 32 stacks of 10 crates, as the maps stack them, for solver settings.
+static void buildCrateStacks(SceneState& state, SceneRandom&) {
+    buildCrateStacksScene(*state.world, 32, 10);
+}
+
+// The arena with 50 players running around and each shooting a paint ball 6 times a second.
+static void buildFirefight(SceneState& state, SceneRandom& random) {
+    buildArenaScene(*state.world, random.state, 50, 0);
+    int count = -state.world->exportCharacterStates(nullptr, 0);
+    btAlignedObjectArray<PhysicsCharacterState> characters;
+    characters.resize(btMax(count, 1));
+    count = state.world->exportCharacterStates(&characters[0], count);
+    for (int i = 0; i < count; i++) state.players.push_back(state.world->body(characters[i].body));
+}
+
+static void firefightFrame(SceneState& state, SceneRandom& random, int step) {
+    int players = state.players.size();
+    state.commands.resize(0);
+    for (int i = 0; i < players; i++) {
+        int32_t ref = PhysicsWorld::bodyIndex(state.players[i]);
+        if ((step + i) % 60 == 0) { // change direction every second, jumping now and then
+            state.commands.push_back(PHYSICS_CMD_MOVE_CHARACTER);
+            state.commands.push_back(ref);
+            state.pushFloat((float) random.between(-8, 8));
+            state.pushFloat(0.0f);
+            state.pushFloat((float) random.between(-8, 8));
+            state.pushFloat(random.between(0, 3) == 0 ? 6.0f : 0.0f);
+        }
+        if ((step + i) % 10 == 0) { // shoot at another player
+            float from[PHYSICS_BODY_STATE_FLOATS], to[PHYSICS_BODY_STATE_FLOATS];
+            PhysicsWorld::getBodyState(state.players[i], from);
+            PhysicsWorld::getBodyState(state.players[(i + 1 + random.between(0, players - 2)) % players], to);
+            btVector3 direction(to[0] - from[0], to[1] - from[1], to[2] - from[2]);
+            if (direction.fuzzyZero()) continue;
+            btVector3 velocity = direction.normalized() * 60.0f;
+            state.commands.push_back(PHYSICS_CMD_SPAWN_PROJECTILE);
+            state.pushFloat(from[0]);
+            state.pushFloat(from[1] + 1.5f);
+            state.pushFloat(from[2]);
+            state.pushFloat(velocity.x());
+            state.pushFloat(velocity.y());
+            state.pushFloat(velocity.z());
+            state.pushFloat(0.2f);
+            state.pushFloat(3.0f);
+            state.commands.push_back(ref);
+            state.commands.push_back(-1);
+        }
+    }
+    if (state.commands.size() > 0) {
+        state.world->applyCommands(&state.commands[0], state.commands.size(), &state.results[0], state.results.size() / 2);
+    }
+    while (state.world->readProjectileHits(&state.hits[0], state.hits.size()) == state.hits.size()) {}
+}
+
+static const Scene SCENES[] = {
+    { "arena", buildArena, nullptr },
+    { "crate-pile", buildCratePile, nullptr },
+    { "crate-stacks", buildCrateStacks, nullptr },
+    { "firefight", buildFirefight, firefightFrame },
+};
+
+static double percentile(const btAlignedObjectArray<double>& sorted, double p) {
+    int i = (int)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static const char* SOLVER_NAMES[PHYSICS_SOLVER_COUNT] = { "si", "nncg", "dantzig", "lemke", "pgs" };
+
+static void runScene(const Scene& scene, const PhysicsWorldConfig& config, int steps) {
+    SceneRandom random = { 1234u };
+    long long setupAllocations = allocations;
+    SceneState state;
+    state.world = PhysicsWorld::create(config);
+    state.results.resize(2 * 64);
+    state.hits.resize(64);
+    state.commands.reserve(1024);
+    scene.build(state, random);
+    setupAllocations = allocations - setupAllocations;
+    for (int step = 0; step < WARMUP_STEPS; step++) {
+        if (scene.frame != nullptr) scene.frame(state, random, step);
+        state.world->simulate(STEP);
+    }
+
+    btAlignedObjectArray<double> millis;
+    millis.resize(steps);
+    long long stepAllocations = allocations, stepBytes = allocatedBytes;
+    for (int step = 0; step < steps; step++) {
+        auto start = std::chrono::steady_clock::now();
+        if (scene.frame != nullptr) scene.frame(state, random, WARMUP_STEPS + step);
+        state.world->simulate(STEP);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        millis[step] = elapsed.count();
+    }
+    stepAllocations = allocations - stepAllocations;
+    stepBytes = allocatedBytes - stepBytes;
+
+    double total = 0.0;
+    for (int i = 0; i < steps; i++) total += millis[i];
+    millis.quickSort([](double a, double b) { return a < b; });
+    int slots = -state.world->exportBodyStates(false, nullptr, 0);
+    int bodies = 0;
+    for (int i = 0; i < slots; i++) bodies += state.world->body(i) != nullptr;
+    int projectiles = -state.world->exportProjectiles(nullptr, 0);
+    float stats[PHYSICS_STATS_FLOATS];
+    state.world->readStepStats(stats);
+    printf("{\"scene\":\"%s\",\"threads\":%d,\"solver\":\"%s\",\"iterations\":%d,"
+           "\"steps\":%d,\"bodies\":%d,\"projectiles\":%d,\"pairs\":%d,"
+           "\"mean_ms\":%.4f,\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f,"
+           "\"setup_allocs\":%lld,\"allocs_per_step\":%.2f,\"alloc_bytes_per_step\":%.1f,"
+           "\"rss_kb\":%ld,\"peak_rss_kb\":%ld}\n",
+           scene.name, state.world->threads(), SOLVER_NAMES[config.solver], config.solverIterations,
+           steps, bodies, projectiles, (int) stats[PHYSICS_STAT_PAIRS],
+           total / steps, percentile(millis, 0.5), percentile(millis, 0.9), percentile(millis, 0.99), millis[steps - 1],
+           setupAllocations, (double) stepAllocations / steps, (double) stepBytes / steps,
+           residentKilobytes(), peakResidentKilobytes());
+    fflush(stdout);
+    PhysicsWorld::destroy(state.world);
+}
+
+int main(int argc, char** argv) {
+    btAlignedAllocSetCustom(bulletAlloc, bulletFree); // before bullet allocates anything
+    int steps = 600;
+    PhysicsWorldConfig config = PhysicsWorld::defaultConfig();
+    btAlignedObjectArray<const Scene*> scenes;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            config.solverIterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--solver") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            config.solver = -1;
+            for (int kind = 0; kind < PHYSICS_SOLVER_COUNT; kind++) {
+                if (strcmp(name, SOLVER_NAMES[kind]) == 0) config.solver = kind;
+            }
+            if (config.solver < 0) {
+                fprintf(stderr, "%s: unknown solver %s\n", argv[0], name);
+                return 2;
+            }
+        } else {
+            const Scene* found = nullptr;
+            for (const Scene& scene : SCENES) {
+                if (strcmp(argv[i], scene.name) == 0) found = &scene;
+            }
+            if (found == nullptr) {
+                fprintf(stderr, "usage: %s [--steps n] [--threads n] [--solver si|nncg|dantzig|lemke|pgs] "
+                                "[--iterations n] [arena|crate-pile|crate-stacks|firefight...]\n", argv[0]);
+                return 2;
+            }
+            scenes.push_back(found);
+        }
+    }
+    if (steps <= 0) steps = 1;
+    if (scenes.size() == 0) {
+        for (const Scene& scene : SCENES) scenes.push_back(&scene);
+    }
+    for (int i = 0; i < scenes.size(); i++) runScene(*scenes[i], config, steps);
+    return 0;
+}
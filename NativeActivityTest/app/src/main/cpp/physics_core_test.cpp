@@ -0,0 +1,76 @@
+// Desktop tests of the native physics core, through the same PhysicsWorld API the app binds to.
+// Built by CMakeLists.txt when not building for android, and run by ctest. Prints a line per test
+// and exits 1 if any fails.
+
+#include "PhysicsWorld.h"
+#include "LinearMath/btAlignedObjectArray.h"
+
+#include <cstdio>
+#include <cstring>
+
+static void pushFloat(btAlignedObjectArray<int32_t>& words, float value) {
+    int32_t word;
+    memcpy(&word, &value, sizeof(word));
+    words.push_back(word);
+}
+
+// Removes a child of a static batch through the command stream, followed by a velocity change of
+// a crate, and checks both were applied: a command after REMOVE_BATCH_CHILD used to be dropped
+// with it, as applyCommands ended the stream at any opcode past REMOVE_PROJECTILE.
+static bool testRemoveBatchChildThenCommand() {
+    PhysicsWorld* world = PhysicsWorld::create(PhysicsWorld::defaultConfig());
+    const PhysicsStaticBox boxes[2] = {
+        { { 0.0f, 0.0f, 0.0f }, { 2.0f, 1.0f, 2.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } },
+        { { 10.0f, 0.0f, 0.0f }, { 2.0f, 1.0f, 2.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } },
+    };
+    PhysicsBody* batch = world->createStaticBatch(boxes, 2, 0, 0);
+    const float pos[3] = { 0.0f, 10.0f, 0.0f };
+    const float crate[3] = { 1.0f, 1.0f, 1.0f };
+    PhysicsBody* body = world->createBody(PHYSICS_TYPE_BOX, 3.0f, pos, crate);
+
+    btAlignedObjectArray<int32_t> commands;
+    commands.push_back(PHYSICS_CMD_REMOVE_BATCH_CHILD);
+    commands.push_back(PhysicsWorld::bodyIndex(batch));
+    commands.push_back(1);
+    commands.push_back(PHYSICS_CMD_SET_VELOCITY);
+    commands.push_back(PhysicsWorld::bodyIndex(body));
+    const float velocity[6] = { 1.0f, 2.0f, 3.0f, 0.0f, 0.0f, 0.0f };
+    for (float value : velocity) pushFloat(commands, value);
+    world->applyCommands(&commands[0], commands.size(), nullptr, 0);
+
+    float state[PHYSICS_BODY_STATE_FLOATS];
+    PhysicsWorld::getBodyState(body, state);
+    bool velocitySet = state[7] == 1.0f && state[8] == 2.0f && state[9] == 3.0f;
+    // straight down onto each child: the kept one is hit, the removed one isn't
+    PhysicsRayQuery rays[2] = {
+        { { 0.0f, 5.0f, 0.0f }, { 0.0f, -5.0f, 0.0f }, -1 },
+        { { 10.0f, 5.0f, 0.0f }, { 10.0f, -5.0f, 0.0f }, -1 },
+    };
+    PhysicsRayHit hits[2];
+    world->castRays(rays, hits, 2);
+    bool childRemoved = hits[0].body == PhysicsWorld::bodyIndex(batch) && hits[1].body == -1;
+    PhysicsWorld::destroy(world);
+
+    if (!velocitySet) fprintf(stderr, "  velocity after REMOVE_BATCH_CHILD not applied\n");
+    if (!childRemoved) fprintf(stderr, "  batch child not removed\n");
+    return velocitySet && childRemoved;
+}
+
+struct Test {
+    const char* name;
+    bool (*run)();
+};
+
+static const Test TESTS[] = {
+    { "remove-batch-child-then-command", testRemoveBatchChildThenCommand },
+};
+
+int main() {
+    int failed = 0;
+    for (const Test& test : TESTS) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        if (!passed) failed++;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+// Benchmark scenes, built through the PhysicsWorld API so the benchmarks of PhysicsWorld.cpp
+// and physics_bench.cpp step the same worlds.
+#ifndef SNOWER_PHYSICS_SCENES_H
+#define SNOWER_PHYSICS_SCENES_H
+
+#include <cstring>
+#include "PhysicsWorld.h"
+
+// Tiny deterministic generator, so benchmark scenes are the same on every run and device.
+struct SceneRandom {
+    unsigned int state;
+
+    int between(int min, int max) { // inclusive, as randBetween in Util.kt
+        state = state * 1664525u + 1013904223u;
+        return min + (int)((state >> 8) % (unsigned int)(max - min + 1));
+    }
+};
+
+// Builds the arena of Server.generateWorld (ground, 4 walls, random walls and crates),
+// plus the given number of players and paint balls in flight. Balls are projectiles, as the game
+// fires them, or with ballBodies bullet rigid bodies, a load on the broadphase projectiles aren't.
+inline void buildArenaScene(PhysicsWorld& world, unsigned int seed, int players, int balls, bool ballBodies = false) {
+    SceneRandom random = { seed };
+    const float crate[3] = { 1.0f, 1.0f, 1.0f };
+    for (int i = 0; i <= 20; i++) {
+        float pos[3] = { (float) random.between(-40, 40), 2.0f, (float) random.between(-40, 40) };
+        world.createBody(PHYSICS_TYPE_BOX, 3.0f, pos, crate);
+    }
+    const float walls[5][6] = { // position, size
+        { 0.0f, 0.0f, 0.0f, 100.0f, 1.0f, 100.0f },
+        { -50.0f, -15.0f, 0.0f, 2.0f, 50.0f, 100.0f },
+        { 50.0f, -15.0f, 0.0f, 2.0f, 50.0f, 100.0f },
+        { 0.0f, -15.0f, -50.0f, 100.0f, 50.0f, 2.0f },
+        { 0.0f, -15.0f, 50.0f, 100.0f, 50.0f, 2.0f },
+    };
+    for (const float* wall : walls) {
+        world.createBody(PHYSICS_TYPE_BOX, 0.0f, wall, wall + 3);
+    }
+    for (int i = 0; i <= 25; i++) {
+        int axis = random.between(0, 2);
+        float height = (float) random.between(3, 10);
+        float pos[3] = { (float) random.between(-50, 50), 2.0f, (float) random.between(-50, 50) };
+        float size[3] = { axis == 0 ? 2.0f : 6.0f, height, axis == 0 ? 6.0f : 2.0f };
+        world.createBody(PHYSICS_TYPE_BOX, 0.0f, pos, size);
+    }
+    const float player[3] = { 1.0f, 2.0f, 1.0f };
+    for (int i = 0; i < players; i++) {
+        float pos[3] = { (float) random.between(-20, 20), 15.0f, (float) random.between(-20, 20) };
+        world.createBody(PHYSICS_TYPE_CHARACTER, 30.0f, pos, player);
+    }
+    const float ball[3] = { 0.2f, 0.2f, 0.2f };
+    const float noSpin[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < balls; i++) {
+        float pos[3] = { (float) random.between(-45, 45), (float) random.between(1, 8), (float) random.between(-45, 45) };
+        float velocity[3] = { (float) random.between(-100, 100), (float) random.between(-10, 10), (float) random.between(-100, 100) };
+        if (ballBodies) {
+            PhysicsBody* body = world.createBody(PHYSICS_TYPE_BULLET, 3.0f, pos, ball);
+            PhysicsWorld::setBodyVelocity(body, velocity, noSpin);
+            continue;
+        }
+        const float args[8] = { pos[0], pos[1], pos[2], velocity[0], velocity[1], velocity[2], ball[0], 15.0f };
+        int32_t words[11] = { PHYSICS_CMD_SPAWN_PROJECTILE };
+        memcpy(&words[1], args, sizeof(args));
+        words[9] = PHYSICS_NO_BODY_REF; // no owner
+        words[10] = -1; // hits everything
+        world.applyCommands(words, 11, nullptr, 0);
+    }
+}
+
+// The ground and a grid of stacks, each of height crates resting on each other, as the maps stack
+// them. Crates are created after the ground, stack by stack and bottom up.
+inline void buildCrateStacksScene(PhysicsWorld& world, int stacks, int height) {
+    const float ground[3] = { 0.0f, 0.0f, 0.0f };
+    const float groundSize[3] = { 100.0f, 1.0f, 100.0f };
+    const float crate[3] = { 1.0f, 1.0f, 1.0f };
+    world.createBody(PHYSICS_TYPE_BOX, 0.0f, ground, groundSize);
+    for (int i = 0; i < stacks; i++) {
+        for (int level = 0; level < height; level++) {
+            float pos[3] = { (i % 8) * 4.0f - 14.0f, 1.0f + level * 1.0f, (i / 8) * 4.0f - 14.0f };
+            world.createBody(PHYSICS_TYPE_BOX, 3.0f, pos, crate);
+        }
+    }
+}
+
+#endif // SNOWER_PHYSICS_SCENES_H
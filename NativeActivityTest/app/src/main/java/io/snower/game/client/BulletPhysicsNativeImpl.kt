@@ -1,24 +1,40 @@
 package io.snower.game.client
 
 import io.snower.game.common.*
+import java.io.File
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
+import java.nio.channels.FileChannel
 import java.util.*
+import javax.vecmath.Vector3f
 
 /** Implements physics with bullet 2.x using JNI mostly. */
 class BulletPhysicsNativeImpl : PhysicsInterface {
 
     // Native physics functions.
-    private external fun createWorld(): Long
+    private external fun createWorld(
+        threads: Int,
+        broadphase: Int, // BROADPHASE_* in companion
+        minX: Float, minY: Float, minZ: Float, // bounds, for sweep and prune broadphases
+        maxX: Float, maxY: Float, maxZ: Float,
+        linearSleepThreshold: Float, angularSleepThreshold: Float, deactivationTime: Float, // 0 never sleeps
+        solver: Int, solverIterations: Int, simdSolver: Boolean, warmstartingFactor: Float // SOLVER_* in companion
+    ): Long
     private external fun deleteWorld(handle: Long)
     private external fun createBodyInWorld(
         worldHandle: Long,
         type: Int, // TYPE_* in companion
         mass: Float,
         x: Float, y: Float, z: Float,
-        sx: Float, sy: Float, sz: Float
+        sx: Float, sy: Float, sz: Float,
+        group: Int, mask: Int, // COLLISION_* in companion. group 0 for bullet defaults
+        ownerHandle: Long // 0 for none
     ): Long
     private external fun deleteBodyFromWorld(worldHandle: Long, bodyHandle: Long)
-    private external fun simulate(worldHandle: Long, time: Float)
-    private external fun getBodyOpenGLMatrix(bodyHandle: Long, dst: FloatArray)
+    private external fun simulate(worldHandle: Long, time: Float): Int // returns substeps simulated
+    private external fun getBodyOpenGLMatrix(bodyHandle: Long, interpolated: Boolean, dst: FloatArray)
     private external fun getBodyHandleData(bodyHandle: Long, dst: FloatArray) // to update box data with simulation data
     private external fun updateBodyWorldTransform(
         bodyHandle: Long,
@@ -28,117 +44,1186 @@ class BulletPhysicsNativeImpl : PhysicsInterface {
         bodyHandle: Long,
         linearX: Float, linearY: Float, linearZ: Float,
         angularX: Float, angularY: Float, angularZ: Float)
+    private external fun getBodyIndex(bodyHandle: Long): Int
+    private external fun exportBodyStates(worldHandle: Long, interpolated: Boolean, dst: ByteBuffer): Int // slots in use, -(slots in use) if dst is too small
+    private external fun applyCommands(worldHandle: Long, commands: ByteBuffer, length: Int, results: ByteBuffer): Int
+    private external fun exportChangedBodyStates(worldHandle: Long, interpolated: Boolean, dst: ByteBuffer, changed: ByteBuffer): Int
+    private external fun getPoolStats(worldHandle: Long, dst: IntArray)
+    private external fun resetWorld(worldHandle: Long)
+    private external fun prewarmWorlds(count: Int, bodies: Int, threads: Int)
+    private external fun setStepping(worldHandle: Long, fixedTimeStep: Float, maxSubSteps: Int)
+    private external fun getInterpolationFraction(worldHandle: Long): Float
+    private external fun readContactEvents(worldHandle: Long, dst: ByteBuffer): Int
+    private external fun getDroppedContactEvents(worldHandle: Long): Long
+    private external fun setContactEvents(worldHandle: Long, enabled: Boolean)
+    private external fun runSteppingBenchmark(threadCounts: IntArray, steps: Int, results: FloatArray)
+    private external fun castRays(worldHandle: Long, rays: ByteBuffer, count: Int, hits: ByteBuffer): Int
+    private external fun queryRegion(worldHandle: Long, query: ByteBuffer, dst: ByteBuffer): Int // -(bodies) if dst is too small
+    private external fun runRaycastBenchmark(rays: Int, iterations: Int): Float
+    private external fun exportProjectiles(worldHandle: Long, dst: ByteBuffer): Int // -(live projectiles) if dst is too small
+    private external fun readProjectileHits(worldHandle: Long, dst: ByteBuffer): Int
+    private external fun runProjectileBenchmark(projectiles: Int, steps: Int): Float
+    private external fun exportCharacterStates(worldHandle: Long, dst: ByteBuffer): Int // -(characters) if dst is too small
+    private external fun createStaticBatch(worldHandle: Long, boxes: ByteBuffer, count: Int, group: Int, mask: Int): Long
+    private external fun runBroadphaseBenchmark(steps: Int, results: FloatArray)
+    private external fun runSolverBenchmark(solvers: IntArray, iterations: IntArray, steps: Int, results: FloatArray)
+    private external fun exportActivationStates(worldHandle: Long, counts: IntArray, bits: ByteBuffer): Int // -(slots) if bits is too small
+    private external fun snapshotWorld(worldHandle: Long, dst: ByteBuffer, withContacts: Boolean): Int // -(bytes needed) if dst is too small
+    private external fun restoreWorld(worldHandle: Long, src: ByteBuffer, length: Int): Int // -1 if src isn't a snapshot
+    private external fun setDeterministic(worldHandle: Long, deterministic: Boolean)
+    private external fun stepTicks(worldHandle: Long, ticks: Int)
+    private external fun getTick(worldHandle: Long): Int
+    private external fun getStateHash(worldHandle: Long, tick: Int): Long // 0 if not hashed
+    private external fun saveCheckpoint(worldHandle: Long, dst: ByteBuffer): Int // -(bytes needed) if dst is too small
+    private external fun loadCheckpoint(worldHandle: Long, src: ByteBuffer, length: Int, handles: ByteBuffer): Int // -(slots) if handles is too small, -1 if src isn't a checkpoint
+    private external fun readStepStats(worldHandle: Long, dst: FloatArray)
+    private external fun startStepThread(worldHandle: Long): Boolean
+    private external fun stopStepThread(worldHandle: Long)
+    private external fun submitCommands(worldHandle: Long, commands: ByteBuffer, length: Int): Boolean // false if the queue is full
+    private external fun readCommandResults(worldHandle: Long, dst: ByteBuffer): Int // -(pairs) if dst is too small
+    private external fun readFrame(worldHandle: Long, info: ByteBuffer, bodyStates: ByteBuffer, projectiles: ByteBuffer, characters: ByteBuffer): Int // 1 if new, -1 if something doesn't fit
+
+    /**
+     * What's stored in [Box.physicsHandle]. [index] is the body slot in the bulk export buffers.
+     * Until the body is created on the next [simulate], [handle] is 0.
+     * Static boxes merged into a static batch share its body, as child [batchChild].
+     * While the body is asleep, [matrix] (if [matrixValid]) is rendered without asking the native side.
+     * With a step thread, bodies are [inFlight] from their create until its result is read, and
+     * only frames after [createdTick] have them.
+     */
+    private class NativeBody(var handle: Long = 0L, var index: Int = -1, var batchChild: Int = -1) {
+        val isPending get() = handle == 0L
+        val isBatched get() = batchChild >= 0
+        var awake = true
+        val matrix = FloatArray(16)
+        var matrixValid = false
+        var inFlight = false
+        var createdTick = 0
+    }
+
+    /**
+     * What's stored in [Box.physicsHandle] for paint balls, which are native projectiles instead
+     * of bodies. [id] is -1 until spawned on the next [simulate]. Once it hits something it stays
+     * [ended] where it hit, until unregistered.
+     */
+    private class NativeProjectile(var id: Int = -1, var ended: Boolean = false) {
+        val isPending get() = id == -1
+        var inFlight = false
+        var spawnTick = 0
+        var seenTick = 0 // last frame it was live in
+    }
+
+    /** A box created by a command stream the step thread hasn't answered yet, with the handle it had then. */
+    private class InFlightCreate(val box: Box, val handle: Any)
 
     private val boxes = mutableSetOf<Box>()
+    private val pendingCreates = mutableListOf<Box>()
+    private val boxesByIndex = ArrayList<Box?>() // by body index, to map changed bodies back to boxes
     private var worldHandle: Long = 0L
-    private val bodyDataDst = FloatArray(BODY_DATA_SIZE) // tmp, to read simulation data for each box
+    private var deterministic = false
+    private var commands = BufferUtils.createByteBuffer(INITIAL_COMMANDS_BYTES)
+    private var createResults = BufferUtils.createByteBuffer(INITIAL_BODY_CAPACITY * CREATE_RESULT_BYTES)
+    private var bodyStatesCapacity = INITIAL_BODY_CAPACITY
+    private var bodyStatesBuffer = BufferUtils.createByteBuffer(bodyStatesCapacity * BODY_DATA_SIZE * 4)
+    private var bodyStates: FloatBuffer = bodyStatesBuffer.asFloatBuffer()
+    private var changedIndices = BufferUtils.createByteBuffer(bodyStatesCapacity * 4)
+    private val contactEvents = BufferUtils.createByteBuffer(CONTACT_EVENTS_PER_READ * CONTACT_EVENT_BYTES)
+    private val projectilesById = HashMap<Int, Box>()
+    private var projectileStates = BufferUtils.createByteBuffer(INITIAL_PROJECTILE_CAPACITY * PROJECTILE_STATE_BYTES)
+    private val projectileHits = BufferUtils.createByteBuffer(PROJECTILE_HITS_PER_READ * PROJECTILE_HIT_BYTES)
+    private var characterStates = BufferUtils.createByteBuffer(INITIAL_CHARACTER_CAPACITY * CHARACTER_STATE_BYTES)
+    private var staticBoxes = BufferUtils.createByteBuffer(INITIAL_BODY_CAPACITY * STATIC_BOX_BYTES)
+    private var activationBits = BufferUtils.createByteBuffer(INITIAL_BODY_CAPACITY / 8)
+    private var checkpointBuffer = BufferUtils.createByteBuffer(INITIAL_CHECKPOINT_BYTES)
+    private var checkpointHandles = BufferUtils.createByteBuffer(INITIAL_BODY_CAPACITY * 8)
+    private val regionQuery = BufferUtils.createByteBuffer(REGION_QUERY_BYTES)
+    private var regionBodies = BufferUtils.createByteBuffer(INITIAL_REGION_CAPACITY * 4)
+    private var collisionCallback: ((Box, Box) -> Unit)? = null // contacts aren't scanned natively without one
+
+    // Step thread mode: command streams submitted and not answered yet, oldest first, the creates
+    // of the stream in commands if the queue couldn't take it, and the latest frame read.
+    private var stepThreadRunning = false
+    private val inFlightStreams = ArrayDeque<List<InFlightCreate>>()
+    private var unsentCreates: List<InFlightCreate>? = null
+    private var commandResults = BufferUtils.createByteBuffer(INITIAL_BODY_CAPACITY * CREATE_RESULT_BYTES)
+    private val frameInfo = BufferUtils.createByteBuffer(FRAME_INFO_BYTES)
+    private var frameTick = 0
+
+    /**
+     * Native object counts, as (live, pooled) pairs for each POOL_* kind: live objects are in use,
+     * pooled ones are allocated and ready to be reused. Refreshed by [updatePoolStats].
+     */
+    val poolStats = IntArray(POOL_COUNT * 2)
+
+    fun updatePoolStats() {
+        checkNoStepThread()
+        getPoolStats(worldHandle, poolStats)
+    }
+
+    /**
+     * Where the time of the last [simulate] went, natively: millis in each PHASE_* (indices 0 until
+     * PHASE_COUNT), then at the STAT_* indices millis in bullet stepping overall, fixed steps, and
+     * overlapping pairs, contact manifolds and contact points after it.
+     */
+    val stepStats = FloatArray(STATS_FLOATS)
+
+    /** [stepStats] in a line, for stats overlays and logs. */
+    fun stepStatsSummary(): String {
+        val phases = PHASE_NAMES.withIndex().joinToString(" ") { (i, name) -> "%s %.2f".format(name, stepStats[i]) }
+        return "%s ms  pairs %d  manifolds %d  contacts %d".format(
+            phases, stepStats[STAT_PAIRS].toInt(), stepStats[STAT_MANIFOLDS].toInt(), stepStats[STAT_CONTACTS].toInt())
+    }
+
+    /** How many non-static bodies are in each ACTIVATION_* state, as of the last [simulate]. */
+    val activationCounts = IntArray(ACTIVATION_STATE_COUNT)
 
-    fun init() {
+    /**
+     * Creates the native world. With [threads] > 1 the world is stepped by that many threads, if bullet supports it.
+     * [broadphase] is one of BROADPHASE_*. Sweep and prune ones are only fast for bodies within [worldMin] and [worldMax].
+     * Bodies slower than [linearSleepThreshold] (units/s) and [angularSleepThreshold] (rad/s) for
+     * [deactivationTime] seconds go to sleep, and aren't simulated nor synced until woken up (0 never sleeps).
+     * Contacts are solved by a SOLVER_* [solver] in [solverIterations], with SIMD if [simdSolver], starting
+     * from [warmstartingFactor] of the impulses of the last step (see [benchmarkSolvers] to pick them).
+     * A [deterministic] world (always single threaded) is for lockstep: stepped by [stepTicks], peers
+     * creating the same boxes and committing the same changes at the same ticks get the same [stateHash]es.
+     */
+    fun init(
+        threads: Int = 1,
+        broadphase: Int = BROADPHASE_DBVT,
+        worldMin: Vector3f = ARENA_MIN,
+        worldMax: Vector3f = ARENA_MAX,
+        linearSleepThreshold: Float = 0.8f,
+        angularSleepThreshold: Float = 1f,
+        deactivationTime: Float = 2f,
+        deterministic: Boolean = false,
+        solver: Int = SOLVER_SI,
+        solverIterations: Int = 10,
+        simdSolver: Boolean = true,
+        warmstartingFactor: Float = 0.85f
+    ) {
         check(worldHandle == 0L) { "worldHandle already initialized (is $worldHandle)"}
-        worldHandle = createWorld()
+        worldHandle = createWorld(
+            if (deterministic) 1 else threads, broadphase,
+            worldMin.x, worldMin.y, worldMin.z, worldMax.x, worldMax.y, worldMax.z,
+            linearSleepThreshold, angularSleepThreshold, deactivationTime,
+            solver, solverIterations, simdSolver, warmstartingFactor)
+        setStepping(worldHandle, FIXED_TIME_STEP, MAX_SUB_STEPS)
+        setDeterministic(worldHandle, deterministic)
+        setContactEvents(worldHandle, collisionCallback != null)
+        this.deterministic = deterministic
     }
 
     fun destroy() {
         check(worldHandle != 0L) { "worldHandle not initialized (is $worldHandle)"}
-        deleteWorld(worldHandle)
+        deleteWorld(worldHandle) // stops the step thread too
+        worldHandle = 0L
+        stepThreadRunning = false
+        clearBoxes()
+    }
+
+    /** Removes all boxes, keeping the native world and its allocations. Use on map or game mode changes. */
+    fun reset() {
+        check(worldHandle != 0L) { "worldHandle not initialized (is $worldHandle)"}
+        resetWorld(worldHandle) // stops the step thread too
+        stepThreadRunning = false
+        clearBoxes()
+    }
+
+    /**
+     * Moves stepping to a native thread of its own, which advances the world every [FIXED_TIME_STEP]
+     * while the render thread goes on: [simulate] then only queues changes and reads the latest
+     * frame the step thread published, without waiting for it. Boxes lag a step behind the changes
+     * committed, collision callbacks aren't called, static boxes aren't batched, and snapshots,
+     * checkpoints, ray casts and lockstep need [stopStepThread] first.
+     */
+    fun startStepThread() {
+        check(worldHandle != 0L) { "worldHandle not initialized (is $worldHandle)"}
+        flushCommands()
+        val current = tick
+        if (!startStepThread(worldHandle)) return
+        stepThreadRunning = true
+        frameTick = current
+    }
+
+    /** Back to stepping in [simulate], once the creates in flight are bound and every change is applied. */
+    fun stopStepThread() {
+        if (!stepThreadRunning) return
+        // let the thread apply every stream it was handed, since the ones still queued are dropped
+        while (inFlightStreams.isNotEmpty()) {
+            bindCommandResults()
+            if (inFlightStreams.isNotEmpty()) Thread.sleep(1)
+        }
+        stopStepThread(worldHandle)
+        stepThreadRunning = false
+        setContactEvents(worldHandle, collisionCallback != null)
+        // then the one the queue couldn't take, and whatever is pending as usual
+        unsentCreates?.let { unsent ->
+            unsentCreates = null
+            applyStream(unsent)
+        }
+        flushCommands()
+        syncBodyStates()
+        syncActivation()
+        syncCharacters()
+    }
+
+    private fun checkNoStepThread() {
+        check(!stepThreadRunning) { "not while the step thread runs" }
+    }
+
+    /**
+     * Prepares up to [worlds] native worlds with room for [bodies] each, so later [init] calls with
+     * [threads] (and the default broadphase) are instant.
+     */
+    fun prewarm(worlds: Int, bodies: Int, threads: Int = 1) {
+        prewarmWorlds(worlds, bodies, threads)
+    }
+
+    /**
+     * Steps the stock arena scene natively with each of [threadCounts] threads,
+     * returning the average millis per step for each. Results are logged too.
+     */
+    fun benchmarkStepping(threadCounts: IntArray = intArrayOf(1, 2, 4, 8), steps: Int = 600): FloatArray {
+        val results = FloatArray(threadCounts.size)
+        runSteppingBenchmark(threadCounts, steps, results)
+        return results
+    }
+
+    /**
+     * Steps crowded and sparse arena scenes natively with each broadphase, balls being rigid
+     * bodies there instead of projectiles so the broadphase has them, returning for each
+     * BROADPHASE_* and then scene (crowded, sparse): millis per step, millis of those updating
+     * the broadphase, and overlapping pairs. Results are logged too.
+     */
+    fun benchmarkBroadphases(steps: Int = 600): FloatArray {
+        val results = FloatArray(BROADPHASE_COUNT * 2 * 3)
+        runBroadphaseBenchmark(steps, results)
+        return results
+    }
+
+    /**
+     * Steps 32 stacks of 10 crates natively with each SOLVER_* of [solvers] and the iteration count
+     * at the same position in [iterations], returning for each: millis per step, millis of those in
+     * the solver, average distance crates drifted from their stack and fraction of crates that fell.
+     * Results are logged too.
+     */
+    fun benchmarkSolvers(
+        solvers: IntArray = intArrayOf(SOLVER_SI, SOLVER_SI, SOLVER_SI, SOLVER_NNCG, SOLVER_MLCP_DANTZIG),
+        iterations: IntArray = intArrayOf(4, 6, 10, 6, 10),
+        steps: Int = 600
+    ): FloatArray {
+        val results = FloatArray(minOf(solvers.size, iterations.size) * 4)
+        runSolverBenchmark(solvers, iterations, steps, results)
+        return results
+    }
+
+    private fun clearBoxes() {
+        for (box in boxes) box.physicsHandle = null
         boxes.clear()
+        boxesByIndex.clear()
+        projectilesById.clear()
+        pendingCreates.clear()
+        inFlightStreams.clear()
+        unsentCreates = null
+        commands.clear()
     }
 
+    // Bodies are created, updated and deleted through the command buffer, flushed natively
+    // in a single call at the start of simulate().
+
     override fun register(box: Box) {
         if (box !in boxes) {
-            val (x, y, z) = box.position
-            val (sx, sy, sz) = box.size
-            // TODO: make this properly from common, to server-client
-            val type = if (box.isSphere) TYPE_BULLET else if (box.isCharacter) TYPE_CHARACTER else TYPE_BOX
-            val bodyHandle = createBodyInWorld(worldHandle, type, box.mass, x, y, z, sx, sy, sz)
-            box.physicsHandle = bodyHandle
+            box.physicsHandle = if (box.isSphere) NativeProjectile() else NativeBody()
+            pendingCreates += box
             boxes += box
         }
     }
 
     override fun unRegister(box: Box) {
         if (box in boxes) {
-            val bodyHandle = box.physicsHandle as Long
-            deleteBodyFromWorld(worldHandle, bodyHandle)
+            val projectile = box.physicsHandle as? NativeProjectile
+            if (projectile != null) {
+                if (projectile.inFlight) {
+                    // removed once spawned, see bindCreated
+                } else if (projectile.isPending) {
+                    pendingCreates -= box
+                } else {
+                    if (!projectile.ended) {
+                        putCommand(CMD_REMOVE_PROJECTILE)
+                        commands.putInt(projectile.id)
+                    }
+                    projectilesById -= projectile.id
+                }
+                boxes -= box
+                return
+            }
+            val body = box.physicsHandle as NativeBody
+            if (body.inFlight) {
+                // destroyed once created, see bindCreated
+            } else if (body.isPending) {
+                pendingCreates -= box
+            } else if (body.isBatched) {
+                putCommand(CMD_REMOVE_BATCH_CHILD)
+                commands.putInt(body.index).putInt(body.batchChild)
+            } else {
+                putCommand(CMD_DESTROY)
+                commands.putInt(body.index)
+                boxesByIndex[body.index] = null
+            }
             boxes -= box
         }
     }
 
     override fun getBoxOpenGLMatrix(box: Box, dst: FloatArray) {
+        val projectile = box.physicsHandle as? NativeProjectile
+        if (projectile != null) {
+            // extrapolated, to render smoothly between fixed steps
+            writeBoxMatrix(box, if (projectile.ended) 0f else interpolationFraction * FIXED_TIME_STEP, dst)
+            return
+        }
+        val body = box.physicsHandle as NativeBody
+        if (body.isPending) return
+        if (body.isBatched) {
+            writeBoxMatrix(box, 0f, dst) // static, so the box knows where it is
+            return
+        }
+        if (stepThreadRunning) {
+            // the world is the step thread's, extrapolate the last frame instead
+            writeBoxMatrix(box, interpolationFraction * FIXED_TIME_STEP, dst)
+            return
+        }
+        // sleeping bodies don't move, so reuse the last matrix
+        if (!body.awake && body.matrixValid) {
+            body.matrix.copyInto(dst)
+            return
+        }
         // this must be done natively.
-        val handle = box.physicsHandle as Long
-        getBodyOpenGLMatrix(handle, dst)
+        getBodyOpenGLMatrix(body.handle, true, body.matrix) // interpolated, to render smoothly between fixed steps
+        body.matrixValid = true
+        body.matrix.copyInto(dst)
     }
 
-    override fun simulate(delta: Int, updateObjs: Boolean, updateId: Int) {
-        val start = System.currentTimeMillis()
+    /** If the box body is sleeping (as of the last [simulate]), so it won't move until something wakes it up. */
+    fun isAsleep(box: Box): Boolean {
+        val body = box.physicsHandle as? NativeBody ?: return false
+        return !body.isPending && (body.isBatched || !body.awake)
+    }
+
+    // OpenGL matrix of the box transform, moved ahead seconds by its velocity.
+    private fun writeBoxMatrix(box: Box, ahead: Float, dst: FloatArray) {
+        val q = box.rotation
+        dst[0] = 1f - 2f*(q.y*q.y + q.z*q.z); dst[1] = 2f*(q.x*q.y + q.z*q.w); dst[2] = 2f*(q.x*q.z - q.y*q.w); dst[3] = 0f
+        dst[4] = 2f*(q.x*q.y - q.z*q.w); dst[5] = 1f - 2f*(q.x*q.x + q.z*q.z); dst[6] = 2f*(q.y*q.z + q.x*q.w); dst[7] = 0f
+        dst[8] = 2f*(q.x*q.z + q.y*q.w); dst[9] = 2f*(q.y*q.z - q.x*q.w); dst[10] = 1f - 2f*(q.x*q.x + q.y*q.y); dst[11] = 0f
+        dst[12] = box.position.x + box.linearVelocity.x * ahead
+        dst[13] = box.position.y + box.linearVelocity.y * ahead
+        dst[14] = box.position.z + box.linearVelocity.z * ahead
+        dst[15] = 1f
+    }
+
+    private fun putCommand(op: Int) {
+        val bytes = (COMMAND_ARGS[op] + 1) * 4
+        if (commands.remaining() < bytes) {
+            val grown = BufferUtils.createByteBuffer(maxOf(commands.capacity() * 2, commands.position() + bytes))
+            commands.flip()
+            grown.put(commands)
+            commands = grown
+        }
+        commands.putInt(op)
+    }
+
+    private fun flushCommands() {
+        // the stream the step thread's queue couldn't take goes first, and alone
+        if (unsentCreates != null && !submitStream()) return
+
+        // bodies are created in the same order on every peer, whatever order boxes were registered in
+        if (deterministic) pendingCreates.sortBy { it.id }
+        if (!stepThreadRunning) batchPendingStatics()
+
+        // Creates go first, so the commits below can refer to new bodies as -(n+1).
+        var createdBodies = 0
+        for (box in pendingCreates) {
+            (box.physicsHandle as? NativeBody)?.index = -(++createdBodies)
+        }
+        for (box in pendingCreates) {
+            if (box.isSphere) {
+                putProjectileSpawn(box)
+                continue
+            }
+            // TODO: make this properly from common, to server-client
+            val type = if (box.isSphere) TYPE_BULLET else if (box.isCharacter) TYPE_CHARACTER else TYPE_BOX
+            val group = collisionGroupOf(box)
+            putCommand(CMD_CREATE)
+            commands.putInt(type).putFloat(box.mass)
+            commands.putFloat(box.position.x).putFloat(box.position.y).putFloat(box.position.z)
+            commands.putFloat(box.size.x).putFloat(box.size.y).putFloat(box.size.z)
+            commands.putInt(group).putInt(collisionMaskOf(group))
+            // the owner must exist already, or be created before in this same stream
+            commands.putInt(bodyRefOf(box.physicsOwner))
+        }
 
         // Commit changes to the engine, if any.
         for (box in boxes) {
+            // balls fly on their own once spawned, and batched statics never move
+            val body = box.physicsHandle as? NativeBody ?: continue
+            if (body.isBatched) continue
+            if (body.inFlight) continue // committed once created
+            val index = body.index
             if (box.shouldCommitTransformChanges) {
-                val handle = box.physicsHandle as Long
-                val (x, y, z) = box.position
-                val (rX, rY, rZ, rW) = box.rotation
-                updateBodyWorldTransform(handle, x, y, z, rX, rY, rZ, rW)
+                body.matrixValid = false
+                putCommand(CMD_SET_TRANSFORM)
+                commands.putInt(index)
+                commands.putFloat(box.position.x).putFloat(box.position.y).putFloat(box.position.z)
+                commands.putFloat(box.rotation.x).putFloat(box.rotation.y).putFloat(box.rotation.z).putFloat(box.rotation.w)
                 box.shouldCommitTransformChanges = false
             }
+            if (box.shouldCommitMomentumChanges && box.isCharacter) {
+                // characters walk and jump through their controller, which handles falling on its own
+                putCommand(CMD_MOVE_CHARACTER)
+                commands.putInt(index)
+                commands.putFloat(box.linearVelocity.x).putFloat(0f).putFloat(box.linearVelocity.z)
+                commands.putFloat(if (box.linearVelocity.y > CHARACTER_JUMP_THRESHOLD) box.linearVelocity.y else 0f)
+                box.shouldCommitMomentumChanges = false
+            }
             if (box.shouldCommitMomentumChanges) {
-                val handle = box.physicsHandle as Long
-                val (lX, lY, lZ) = box.linearVelocity
-                val (aX, aY, aZ) = box.angularVelocity
-                updateBodyVelocity(handle, lX, lY, lZ, aX, aY, aZ)
+                putCommand(CMD_SET_VELOCITY)
+                commands.putInt(index)
+                commands.putFloat(box.linearVelocity.x).putFloat(box.linearVelocity.y).putFloat(box.linearVelocity.z)
+                commands.putFloat(box.angularVelocity.x).putFloat(box.angularVelocity.y).putFloat(box.angularVelocity.z)
                 box.shouldCommitMomentumChanges = false
             }
         }
+        if (commands.position() == 0) return
+
+        val creates = pendingCreates.map { InFlightCreate(it, it.physicsHandle!!) }
+        pendingCreates.clear()
+        if (stepThreadRunning) {
+            for (create in creates) {
+                (create.handle as? NativeBody)?.inFlight = true
+                (create.handle as? NativeProjectile)?.inFlight = true
+            }
+            unsentCreates = creates
+            submitStream()
+        } else {
+            applyStream(creates)
+        }
+    }
+
+    // Command reference to the body of box: its index, -(n+1) if created before in the stream
+    // being built, or NO_BODY_REF if it has none (yet).
+    private fun bodyRefOf(box: Box?): Int {
+        val body = box?.takeIf { it in boxes }?.physicsHandle as? NativeBody ?: return NO_BODY_REF
+        return if (body.inFlight) NO_BODY_REF else body.index
+    }
+
+    // Applies the stream in commands right away, binding each of creates to what it made.
+    private fun applyStream(creates: List<InFlightCreate>) {
+        if (createResults.capacity() < creates.size * CREATE_RESULT_BYTES) {
+            createResults = BufferUtils.createByteBuffer(creates.size * 2 * CREATE_RESULT_BYTES)
+        }
+        val created = applyCommands(worldHandle, commands, commands.position(), createResults)
+        commands.clear()
+        for (n in 0 until created) bindCreated(creates[n], createResults, n * CREATE_RESULT_BYTES, tick)
+    }
+
+    // Hands the stream in commands (made with unsentCreates) to the step thread. False, keeping it
+    // for the next try, if the queue is full.
+    private fun submitStream(): Boolean {
+        check(commands.position() / 4 < STEP_QUEUE_WORDS) { "command stream too big for the step thread" }
+        if (!submitCommands(worldHandle, commands, commands.position())) return false
+        inFlightStreams.addLast(unsentCreates!!)
+        unsentCreates = null
+        commands.clear()
+        return true
+    }
+
+    // Binds the creates of the streams the step thread applied since the last call.
+    private fun bindCommandResults() {
+        do {
+            val pairs = readCommandResults(worldHandle, commandResults)
+            if (pairs < 0) {
+                commandResults = BufferUtils.createByteBuffer(-pairs * 2 * CREATE_RESULT_BYTES)
+                continue
+            }
+            var offset = 0
+            while (offset < pairs * CREATE_RESULT_BYTES) {
+                val count = commandResults.getLong(offset).toInt()
+                val appliedTick = commandResults.getLong(offset + 8).toInt()
+                offset += CREATE_RESULT_BYTES
+                val creates = inFlightStreams.removeFirst()
+                for (n in 0 until count) bindCreated(creates[n], commandResults, offset + n * CREATE_RESULT_BYTES, appliedTick)
+                offset += count * CREATE_RESULT_BYTES
+            }
+        } while (pairs != 0)
+    }
+
+    // Binds a box to the body (or projectile) its create made at tick, as written into results at
+    // offset. If the box was unregistered meanwhile, what was made is removed on the next flush.
+    private fun bindCreated(create: InFlightCreate, results: ByteBuffer, offset: Int, tick: Int) {
+        val box = create.box
+        val live = box in boxes && box.physicsHandle === create.handle
+        val projectile = create.handle as? NativeProjectile
+        if (projectile != null) {
+            projectile.id = results.getLong(offset + 8).toInt()
+            projectile.inFlight = false
+            projectile.spawnTick = tick
+            projectile.seenTick = tick
+            if (live) {
+                projectilesById[projectile.id] = box
+            } else {
+                putCommand(CMD_REMOVE_PROJECTILE)
+                commands.putInt(projectile.id)
+            }
+            return
+        }
+        val body = create.handle as NativeBody
+        body.handle = results.getLong(offset)
+        body.index = results.getLong(offset + 8).toInt()
+        body.inFlight = false
+        body.createdTick = tick
+        if (!live) {
+            putCommand(CMD_DESTROY)
+            commands.putInt(body.index)
+            return
+        }
+        while (boxesByIndex.size <= body.index) boxesByIndex += null
+        boxesByIndex[body.index] = box
+    }
+
+    /**
+     * Static boxes created together (i.e. the whole map when joining) are merged into a single
+     * native body, so level geometry costs a single broadphase proxy however detailed it is.
+     */
+    private fun batchPendingStatics() {
+        val statics = pendingCreates.filter { it.mass == 0f && !it.isSphere && !it.isCharacter }
+        if (statics.size < STATIC_BATCH_MIN_BOXES) return
+
+        if (staticBoxes.capacity() < statics.size * STATIC_BOX_BYTES) {
+            staticBoxes = BufferUtils.createByteBuffer(statics.size * 2 * STATIC_BOX_BYTES)
+        }
+        staticBoxes.clear()
+        for (box in statics) {
+            staticBoxes.putFloat(box.position.x).putFloat(box.position.y).putFloat(box.position.z)
+            staticBoxes.putFloat(box.size.x).putFloat(box.size.y).putFloat(box.size.z)
+            staticBoxes.putFloat(box.rotation.x).putFloat(box.rotation.y).putFloat(box.rotation.z).putFloat(box.rotation.w)
+        }
+        val handle = createStaticBatch(worldHandle, staticBoxes, statics.size, COLLISION_STATIC, collisionMaskOf(COLLISION_STATIC))
+        val index = getBodyIndex(handle)
+        for ((n, box) in statics.withIndex()) {
+            val body = box.physicsHandle as NativeBody
+            body.handle = handle
+            body.index = index
+            body.batchChild = n
+            box.shouldCommitTransformChanges = false
+            box.shouldCommitMomentumChanges = false
+        }
+        while (boxesByIndex.size <= index) boxesByIndex += null
+        boxesByIndex[index] = null // hits on the batch can't tell which box was hit
+        pendingCreates.removeAll(statics)
+    }
+
+    private fun putProjectileSpawn(box: Box) {
+        putCommand(CMD_SPAWN_PROJECTILE)
+        commands.putFloat(box.position.x).putFloat(box.position.y).putFloat(box.position.z)
+        commands.putFloat(box.linearVelocity.x).putFloat(box.linearVelocity.y).putFloat(box.linearVelocity.z)
+        commands.putFloat(box.size.x).putFloat(BALL_LIFETIME)
+        commands.putInt(bodyRefOf(box.physicsOwner))
+        commands.putInt(collisionMaskOf(COLLISION_BALL))
+        box.shouldCommitTransformChanges = false
+        box.shouldCommitMomentumChanges = false
+    }
+
+    private fun collisionGroupOf(box: Box) = when {
+        box.mass == 0f -> COLLISION_STATIC
+        box.isSphere -> COLLISION_BALL
+        box.isCharacter -> COLLISION_CHARACTER
+        else -> COLLISION_BOX
+    }
+
+    // Statics never need pairs between them, and balls pass through each other.
+    private fun collisionMaskOf(group: Int) = when (group) {
+        COLLISION_STATIC -> COLLISION_ALL and COLLISION_STATIC.inv()
+        COLLISION_BALL -> COLLISION_ALL and COLLISION_BALL.inv()
+        else -> COLLISION_ALL
+    }
+
+    override fun simulate(delta: Int, updateObjs: Boolean, updateId: Int) {
+        val start = System.currentTimeMillis()
+
+        if (stepThreadRunning) {
+            // the step thread simulates on its own, so just trade changes for its latest frame
+            bindCommandResults()
+            flushCommands()
+            syncFrame()
+            lastSimulationMillis = (System.currentTimeMillis() - start).toFloat()
+            return
+        }
+
+        // Create, update and delete bodies, all at once
+        flushCommands()
 
         // Simulate
-        simulate(worldHandle, delta.toFloat()/1000f)
+        lastSubSteps = simulate(worldHandle, delta.toFloat()/1000f)
+        interpolationFraction = getInterpolationFraction(worldHandle)
+
+        syncSimulationResults()
+        lastSimulationMillis = (System.currentTimeMillis() - start).toFloat()
+    }
 
-        // Poll simulation results back to java
+    /**
+     * Lockstep stepping: flushes pending changes and simulates exactly [ticks] fixed steps,
+     * however much time passed. Leaves nothing to interpolate.
+     */
+    fun stepTicks(ticks: Int = 1) {
+        checkNoStepThread()
+        val start = System.currentTimeMillis()
+        flushCommands()
+        stepTicks(worldHandle, ticks)
+        lastSubSteps = ticks
+        interpolationFraction = 0f
+        syncSimulationResults()
+        lastSimulationMillis = (System.currentTimeMillis() - start).toFloat()
+    }
+
+    /** Fixed steps simulated since [init] or [reset]. */
+    val tick: Int
+        get() = if (stepThreadRunning) frameTick else getTick(worldHandle)
+
+    /**
+     * Hash of every body and ball after [tick], in a deterministic world. Peers whose hashes differ
+     * desynced at that tick or before. 0 if [tick] is older than the last [STATE_HASH_HISTORY].
+     */
+    fun stateHash(tick: Int = this.tick): Long {
+        checkNoStepThread()
+        return getStateHash(worldHandle, tick)
+    }
+
+    private fun syncSimulationResults() {
+        syncBodyStates()
+        syncActivation()
+        syncCharacters()
+        syncProjectiles()
+        dispatchContactEvents()
+        readStepStats(worldHandle, stepStats)
+    }
+
+    // Poll simulation results back to java, only for bodies that moved
+    private fun syncBodyStates() {
+        var changedCount = exportChangedBodyStates(worldHandle, false, bodyStatesBuffer, changedIndices)
+        if (changedCount < 0) {
+            growBodyStates(-changedCount)
+            changedCount = exportChangedBodyStates(worldHandle, false, bodyStatesBuffer, changedIndices)
+        }
+        for (n in 0 until changedCount) {
+            val i = changedIndices.getInt(n * 4)
+            val box = boxesByIndex.getOrNull(i) ?: continue
+            readBodyState(box, i)
+        }
+    }
+
+    private fun growBodyStates(slots: Int) {
+        bodyStatesCapacity = maxOf(slots, bodyStatesCapacity * 2)
+        bodyStatesBuffer = BufferUtils.createByteBuffer(bodyStatesCapacity * BODY_DATA_SIZE * 4)
+        bodyStates = bodyStatesBuffer.asFloatBuffer()
+        changedIndices = BufferUtils.createByteBuffer(bodyStatesCapacity * 4)
+    }
+
+    // Copies slot i of bodyStates into box.
+    private fun readBodyState(box: Box, i: Int) {
+        val positions = 0
+        val quaternions = bodyStatesCapacity * 3
+        val linearVelocities = bodyStatesCapacity * 7
+        val angularVelocities = bodyStatesCapacity * 10
+
+        // update position
+        box.position.x = bodyStates[positions + i*3 + 0]
+        box.position.y = bodyStates[positions + i*3 + 1]
+        box.position.z = bodyStates[positions + i*3 + 2]
+
+        // update quaternion
+        box.rotation.x = bodyStates[quaternions + i*4 + 0]
+        box.rotation.y = bodyStates[quaternions + i*4 + 1]
+        box.rotation.z = bodyStates[quaternions + i*4 + 2]
+        box.rotation.w = bodyStates[quaternions + i*4 + 3]
+
+        // update velocity
+        box.linearVelocity.x = bodyStates[linearVelocities + i*3 + 0]
+        box.linearVelocity.y = bodyStates[linearVelocities + i*3 + 1]
+        box.linearVelocity.z = bodyStates[linearVelocities + i*3 + 2]
+
+        // update angular velocity
+        box.angularVelocity.x = bodyStates[angularVelocities + i*3 + 0]
+        box.angularVelocity.y = bodyStates[angularVelocities + i*3 + 1]
+        box.angularVelocity.z = bodyStates[angularVelocities + i*3 + 2]
+    }
+
+    // Moves boxes to the latest frame of the step thread, if there's a new one. Bodies and balls
+    // created after the frame are left alone, and balls live before it but not in it have ended.
+    private fun syncFrame() {
+        var read = readFrame(worldHandle, frameInfo, bodyStatesBuffer, projectileStates, characterStates)
+        if (read < 0) {
+            val slots = frameInfo.getInt(4)
+            val projectiles = frameInfo.getInt(8)
+            val characters = frameInfo.getInt(12)
+            if (slots > bodyStatesCapacity) growBodyStates(slots)
+            if (projectiles * PROJECTILE_STATE_BYTES > projectileStates.capacity()) {
+                projectileStates = BufferUtils.createByteBuffer(projectiles * 2 * PROJECTILE_STATE_BYTES)
+            }
+            if (characters * CHARACTER_STATE_BYTES > characterStates.capacity()) {
+                characterStates = BufferUtils.createByteBuffer(characters * 2 * CHARACTER_STATE_BYTES)
+            }
+            read = readFrame(worldHandle, frameInfo, bodyStatesBuffer, projectileStates, characterStates)
+        }
+        interpolationFraction = (frameInfo.getFloat(16) / FIXED_TIME_STEP).coerceIn(0f, 1f)
+        if (read != 1) return
+
+        val slots = frameInfo.getInt(4)
+        lastSubSteps = frameInfo.getInt(0) - frameTick
+        frameTick = frameInfo.getInt(0)
+        for (i in 0 until STATS_FLOATS) stepStats[i] = frameInfo.getFloat(FRAME_STATS_OFFSET + i * 4)
         for (box in boxes) {
-            if (box.mass == 0f) continue
+            val body = box.physicsHandle as? NativeBody ?: continue
+            if (body.isPending || body.isBatched || body.createdTick >= frameTick || body.index >= slots) continue
+            readBodyState(box, body.index)
+        }
+        readProjectileStates(frameInfo.getInt(8), frameTick)
+        for (box in projectilesById.values) {
+            val projectile = box.physicsHandle as NativeProjectile
+            if (projectile.ended || projectile.spawnTick >= frameTick || projectile.seenTick == frameTick) continue
+            projectile.ended = true // stays where it was last seen, as hits aren't reported
+            box.linearVelocity.set(0f, 0f, 0f)
+        }
+        readCharacterStates(frameInfo.getInt(12))
+    }
 
-            val handle = box.physicsHandle as Long
-            getBodyHandleData(handle, bodyDataDst)
+    /**
+     * Copies the dynamic state of every body (and contact points too, if [withContacts]) natively
+     * into [dst], grown into a new buffer if it's too small. Returns the buffer, flipped and ready
+     * to [restore]. Only good for this process.
+     */
+    fun snapshot(dst: ByteBuffer? = null, withContacts: Boolean = false): ByteBuffer {
+        checkNoStepThread()
+        flushCommands()
+        var buffer = dst ?: BufferUtils.createByteBuffer(INITIAL_SNAPSHOT_BYTES)
+        var bytes = snapshotWorld(worldHandle, buffer, withContacts)
+        if (bytes < 0) {
+            buffer = BufferUtils.createByteBuffer(-bytes * 2)
+            bytes = snapshotWorld(worldHandle, buffer, withContacts)
+        }
+        buffer.clear()
+        buffer.limit(bytes)
+        return buffer
+    }
 
-            // update position
-            box.position.x = bodyDataDst[POSITION_OFFSET + 0]
-            box.position.y = bodyDataDst[POSITION_OFFSET + 1]
-            box.position.z = bodyDataDst[POSITION_OFFSET + 2]
+    /**
+     * Rewinds every body to a [snapshot], in a single native call, and updates boxes to match.
+     * Bodies removed since are skipped, and bodies added since stay where they are. The tick goes
+     * back to the snapshot's as well.
+     */
+    fun restore(snapshot: ByteBuffer) {
+        checkNoStepThread()
+        flushCommands()
+        check(restoreWorld(worldHandle, snapshot, snapshot.limit()) >= 0) { "not a snapshot" }
+        for (box in boxes) (box.physicsHandle as? NativeBody)?.matrixValid = false
+        syncBodyStates()
+        syncActivation()
+        syncCharacters()
+    }
 
-            // update quaternion
-            box.rotation.x = bodyDataDst[QUATERNION_OFFSET + 0]
-            box.rotation.y = bodyDataDst[QUATERNION_OFFSET + 1]
-            box.rotation.z = bodyDataDst[QUATERNION_OFFSET + 2]
-            box.rotation.w = bodyDataDst[QUATERNION_OFFSET + 3]
+    /**
+     * Saves every body natively into [file] as a bullet checkpoint, followed by the box id of each,
+     * so [loadCheckpoint] can resume the world after a restart. Balls in flight aren't saved.
+     */
+    fun saveCheckpoint(file: File) {
+        checkNoStepThread()
+        flushCommands()
+        var bytes = saveCheckpoint(worldHandle, checkpointBuffer)
+        if (bytes < 0) {
+            checkpointBuffer = BufferUtils.createByteBuffer(-bytes * 2)
+            bytes = saveCheckpoint(worldHandle, checkpointBuffer)
+        }
+        checkpointBuffer.clear()
+        checkpointBuffer.limit(bytes)
 
-            // update velocity
-            box.linearVelocity.x = bodyDataDst[LINEAR_VELOCITY_OFFSET + 0]
-            box.linearVelocity.y = bodyDataDst[LINEAR_VELOCITY_OFFSET + 1]
-            box.linearVelocity.z = bodyDataDst[LINEAR_VELOCITY_OFFSET + 2]
+        // trailer: (box id, body index, batch child) for every body, then their count and the checkpoint bytes
+        val bodies = boxes.filter { it.physicsHandle is NativeBody }
+        val trailer = ByteBuffer.allocate((bodies.size * 3 + 2) * 4).order(ByteOrder.nativeOrder())
+        for (box in bodies) {
+            val body = box.physicsHandle as NativeBody
+            trailer.putInt(box.id).putInt(body.index).putInt(body.batchChild)
+        }
+        trailer.putInt(bodies.size).putInt(bytes)
+        trailer.flip()
+        RandomAccessFile(file, "rw").channel.use { channel ->
+            channel.truncate(0)
+            channel.write(checkpointBuffer)
+            channel.write(trailer)
+        }
+    }
+
+    /**
+     * Replaces every box with the bodies of a [saveCheckpoint] file, memory mapped and loaded natively
+     * in a single call instead of a command per body. Saved bodies are bound to the box of [boxes]
+     * with the same id, and those without one are left out.
+     */
+    fun loadCheckpoint(file: File, boxes: Collection<Box>) {
+        check(worldHandle != 0L) { "worldHandle not initialized (is $worldHandle)"}
+        checkNoStepThread()
+        RandomAccessFile(file, "r").channel.use { channel ->
+            val mapped = channel.map(FileChannel.MapMode.READ_ONLY, 0, channel.size()).order(ByteOrder.nativeOrder())
+            check(mapped.limit() >= 8) { "$file isn't a checkpoint" }
+            val bodyCount = mapped.getInt(mapped.limit() - 8)
+            val bytes = mapped.getInt(mapped.limit() - 4)
+            check(bytes in 0..mapped.limit() - 8 - bodyCount * 12) { "$file isn't a checkpoint" }
+            var slots = loadCheckpoint(worldHandle, mapped, bytes, checkpointHandles)
+            if (slots < -1) {
+                checkpointHandles = BufferUtils.createByteBuffer(-slots * 2 * 8)
+                slots = loadCheckpoint(worldHandle, mapped, bytes, checkpointHandles)
+            }
+            check(slots >= 0) { "$file isn't a checkpoint" }
 
-            // update angular velocity
-            box.angularVelocity.x = bodyDataDst[ANGULAR_VELOCITY_OFFSET + 0]
-            box.angularVelocity.y = bodyDataDst[ANGULAR_VELOCITY_OFFSET + 1]
-            box.angularVelocity.z = bodyDataDst[ANGULAR_VELOCITY_OFFSET + 2]
+            clearBoxes()
+            val boxesById = boxes.associateBy { it.id }
+            for (n in 0 until bodyCount) {
+                val offset = bytes + n * 12
+                val box = boxesById[mapped.getInt(offset)] ?: continue
+                val index = mapped.getInt(offset + 4)
+                val handle = if (index in 0 until slots) checkpointHandles.getLong(index * 8) else 0L
+                if (handle == 0L) continue
+                val body = NativeBody(handle, index, mapped.getInt(offset + 8))
+                box.physicsHandle = body
+                box.shouldCommitTransformChanges = false
+                box.shouldCommitMomentumChanges = false
+                this.boxes += box
+                while (boxesByIndex.size <= index) boxesByIndex += null
+                if (!body.isBatched) boxesByIndex[index] = box
+            }
         }
+        syncBodyStates()
+        syncActivation()
+        syncCharacters()
+    }
 
-        lastSimulationMillis = (System.currentTimeMillis() - start).toFloat()
+    /**
+     * Casts [count] rays in a single native call. [rays] holds RAY_BYTES records: from xyz, to xyz
+     * (floats) and the COLLISION_* mask of groups to hit (int). For each ray, the closest hit is
+     * written in order into [hits], as HIT_BYTES records: body index (int, -1 if nothing was hit),
+     * point xyz, normal xyz and fraction along the ray (floats). Map body indices to boxes with
+     * [boxByBodyIndex]. Returns how many rays hit something.
+     */
+    fun castRays(rays: ByteBuffer, count: Int, hits: ByteBuffer): Int {
+        checkNoStepThread()
+        return castRays(worldHandle, rays, count, hits)
+    }
+
+    /** The box whose body has the given native index, as reported by queries and contacts. */
+    fun boxByBodyIndex(index: Int): Box? = boxesByIndex.getOrNull(index)
+
+    /**
+     * Adds to [dst] the boxes of the COLLISION_* [mask] groups whose bounds overlap the box of
+     * [size] around [center], asking the native broadphase instead of walking every box. Static
+     * boxes merged into a batch come as the whole batch, so they aren't reported. Returns [dst].
+     */
+    fun boxesInBox(center: Vector3f, size: Vector3f, mask: Int = COLLISION_ALL, dst: MutableList<Box> = ArrayList()): MutableList<Box> {
+        return queryRegion(center, size.x, size.y, size.z, 0f, mask, dst)
+    }
+
+    /** Like [boxesInBox], for the boxes whose bounds are within [radius] of [center]. */
+    fun boxesInSphere(center: Vector3f, radius: Float, mask: Int = COLLISION_ALL, dst: MutableList<Box> = ArrayList()): MutableList<Box> {
+        return queryRegion(center, 0f, 0f, 0f, radius, mask, dst)
+    }
+
+    private fun queryRegion(center: Vector3f, sizeX: Float, sizeY: Float, sizeZ: Float, radius: Float, mask: Int, dst: MutableList<Box>): MutableList<Box> {
+        checkNoStepThread()
+        regionQuery.clear()
+        regionQuery.putFloat(center.x).putFloat(center.y).putFloat(center.z)
+        regionQuery.putFloat(sizeX).putFloat(sizeY).putFloat(sizeZ)
+        regionQuery.putFloat(radius).putInt(mask)
+        var count = queryRegion(worldHandle, regionQuery, regionBodies)
+        if (count < 0) {
+            regionBodies = BufferUtils.createByteBuffer(-count * 2 * 4)
+            count = queryRegion(worldHandle, regionQuery, regionBodies)
+        }
+        for (i in 0 until count) {
+            val box = boxByBodyIndex(regionBodies.getInt(i * 4)) ?: continue
+            dst += box
+        }
+        return dst
+    }
+
+    /**
+     * Pushes the boxes of the COLLISION_* [mask] groups within [radius] of [center] away from it,
+     * by [impulse] at the center falling off linearly to nothing at [radius]; for splashes and
+     * explosions. Characters and static boxes don't move. Queued with the other changes, so any
+     * number of them go to the native side in the stream of the next [simulate].
+     */
+    fun applyRadialImpulse(center: Vector3f, radius: Float, impulse: Float, mask: Int = COLLISION_BOX) {
+        putCommand(CMD_RADIAL_IMPULSE)
+        commands.putFloat(center.x).putFloat(center.y).putFloat(center.z)
+        commands.putFloat(radius).putFloat(impulse).putInt(mask)
+    }
+
+    /** Casts [rays] random rays [iterations] times in the stock arena, returning microseconds per ray. */
+    fun benchmarkRaycasts(rays: Int = 256, iterations: Int = 100): Float {
+        return runRaycastBenchmark(rays, iterations)
+    }
+
+    /**
+     * Fires [projectiles] balls around the stock arena and steps them until they hit something,
+     * returning microseconds per ball and step.
+     */
+    fun benchmarkProjectiles(projectiles: Int = 1024, steps: Int = 600): Float {
+        return runProjectileBenchmark(projectiles, steps)
+    }
+
+    private fun syncActivation() {
+        var slots = exportActivationStates(worldHandle, activationCounts, activationBits)
+        if (slots < 0) {
+            activationBits = BufferUtils.createByteBuffer(maxOf((-slots + 31) / 32 * 4, activationBits.capacity() * 2))
+            slots = exportActivationStates(worldHandle, activationCounts, activationBits)
+        }
+        for (i in 0 until slots) {
+            val box = boxesByIndex.getOrNull(i) ?: continue
+            val word = activationBits.getInt((i shr 5) * 4)
+            (box.physicsHandle as NativeBody).awake = (word ushr (i and 31)) and 1 != 0
+        }
+    }
+
+    // Grounded state comes from the character controllers.
+    private fun syncCharacters() {
+        var count = exportCharacterStates(worldHandle, characterStates)
+        if (count < 0) {
+            characterStates = BufferUtils.createByteBuffer(maxOf(-count, characterStates.capacity() / CHARACTER_STATE_BYTES * 2) * CHARACTER_STATE_BYTES)
+            count = exportCharacterStates(worldHandle, characterStates)
+        }
+        readCharacterStates(count)
+    }
+
+    private fun readCharacterStates(count: Int) {
+        for (n in 0 until count) {
+            val offset = n * CHARACTER_STATE_BYTES
+            val box = boxesByIndex.getOrNull(characterStates.getInt(offset)) ?: continue
+            box.inGround = characterStates.getInt(offset + 4) != 0
+        }
+    }
+
+    // Moves balls to where the simulation has them, and leaves the ones that ended where they hit.
+    private fun syncProjectiles() {
+        var count = exportProjectiles(worldHandle, projectileStates)
+        if (count < 0) {
+            projectileStates = BufferUtils.createByteBuffer(maxOf(-count, projectileStates.capacity() / PROJECTILE_STATE_BYTES * 2) * PROJECTILE_STATE_BYTES)
+            count = exportProjectiles(worldHandle, projectileStates)
+        }
+        readProjectileStates(count, tick)
+
+        do {
+            val hits = readProjectileHits(worldHandle, projectileHits)
+            for (n in 0 until hits) {
+                val offset = n * PROJECTILE_HIT_BYTES
+                val box = projectilesById[projectileHits.getInt(offset)] ?: continue
+                (box.physicsHandle as NativeProjectile).ended = true
+                box.position.x = projectileHits.getFloat(offset + 8)
+                box.position.y = projectileHits.getFloat(offset + 12)
+                box.position.z = projectileHits.getFloat(offset + 16)
+                box.linearVelocity.set(0f, 0f, 0f)
+                val hitBox = boxesByIndex.getOrNull(projectileHits.getInt(offset + 4)) ?: continue
+                collisionCallback?.invoke(box, hitBox)
+            }
+        } while (hits == PROJECTILE_HITS_PER_READ)
+    }
+
+    private fun readProjectileStates(count: Int, tick: Int) {
+        for (n in 0 until count) {
+            val offset = n * PROJECTILE_STATE_BYTES
+            val box = projectilesById[projectileStates.getInt(offset)] ?: continue
+            (box.physicsHandle as NativeProjectile).seenTick = tick
+            box.position.x = projectileStates.getFloat(offset + 4)
+            box.position.y = projectileStates.getFloat(offset + 8)
+            box.position.z = projectileStates.getFloat(offset + 12)
+            box.linearVelocity.x = projectileStates.getFloat(offset + 16)
+            box.linearVelocity.y = projectileStates.getFloat(offset + 20)
+            box.linearVelocity.z = projectileStates.getFloat(offset + 24)
+        }
+    }
+
+    override fun onCollision(callback: (Box, Box) -> Unit) {
+        collisionCallback = callback
+        // while the step thread runs, contacts are dropped anyway
+        if (worldHandle != 0L && !stepThreadRunning) setContactEvents(worldHandle, true)
+    }
+
+    /**
+     * Contact events lost since the world was created, because more happened than the native ring holds.
+     * Not counting those of steps on the step thread, which are dropped anyway.
+     */
+    val droppedContactEvents: Long
+        get() {
+            checkNoStepThread()
+            return getDroppedContactEvents(worldHandle)
+        }
+
+    private fun dispatchContactEvents() {
+        val collisionCallback = collisionCallback ?: return
+        do {
+            val count = readContactEvents(worldHandle, contactEvents)
+            for (n in 0 until count) {
+                val offset = n * CONTACT_EVENT_BYTES
+                if (contactEvents.getInt(offset + CONTACT_KIND_OFFSET) != CONTACT_BEGIN) continue
+                val boxA = boxesByIndex.getOrNull(contactEvents.getInt(offset)) ?: continue
+                val boxB = boxesByIndex.getOrNull(contactEvents.getInt(offset + 4)) ?: continue
+                collisionCallback(boxA, boxB)
+            }
+        } while (count == CONTACT_EVENTS_PER_READ)
     }
 
     override var lastSimulationMillis: Float = 0f
         private set
 
+    /** Fixed steps of [FIXED_TIME_STEP] the last [simulate] ran. */
+    var lastSubSteps: Int = 0
+        private set
+
+    /** How far rendered (interpolated) transforms are between the last fixed step and the next, in [0, 1). */
+    var interpolationFraction: Float = 0f
+        private set
+
     companion object {
-        // offsets for getBodyHandleData
-        private const val POSITION_OFFSET = 0
-        private const val QUATERNION_OFFSET = 3
-        private const val LINEAR_VELOCITY_OFFSET = 7
-        private const val ANGULAR_VELOCITY_OFFSET = 10
+        // floats per body in the exportBodyStates buffer
         private const val BODY_DATA_SIZE = 13
+        private const val INITIAL_BODY_CAPACITY = 256
+
+        // the world always advances in steps of FIXED_TIME_STEP, at most MAX_SUB_STEPS per frame.
+        // Longer frames (up to 1s when the app hitches) slow the simulation down instead.
+        const val FIXED_TIME_STEP = 1f / 60f
+        const val MAX_SUB_STEPS = 4
+
+        // ticks a deterministic world keeps the state hashes of
+        const val STATE_HASH_HISTORY = 256
+
+        // applyCommands opcodes, and argument words for each (see PHYSICS_CMD_* in physics_api.h)
+        private const val CMD_SET_TRANSFORM = 0
+        private const val CMD_SET_VELOCITY = 1
+        private const val CMD_APPLY_IMPULSE = 2
+        private const val CMD_CREATE = 3
+        private const val CMD_DESTROY = 4
+        private const val CMD_SPAWN_PROJECTILE = 5
+        private const val CMD_REMOVE_PROJECTILE = 6
+        private const val CMD_MOVE_CHARACTER = 7
+        private const val CMD_REMOVE_BATCH_CHILD = 8
+        private const val CMD_RADIAL_IMPULSE = 9
+        private val COMMAND_ARGS = intArrayOf(8, 7, 7, 11, 1, 10, 1, 5, 2, 6)
+        private const val NO_BODY_REF = Int.MAX_VALUE
+        private const val INITIAL_COMMANDS_BYTES = 16 * 1024
+        private const val CREATE_RESULT_BYTES = 16 // handle and index (or 0 and projectile id), as longs
+        // words of the largest command stream the step thread takes at once
+        private const val STEP_QUEUE_WORDS = 1 shl 17
+
+        // exportProjectiles records: id, position xyz, velocity xyz
+        private const val PROJECTILE_STATE_BYTES = 28
+        private const val INITIAL_PROJECTILE_CAPACITY = 256
+        // readProjectileHits records: id, body (-1 if it expired), point xyz, normal xyz
+        private const val PROJECTILE_HIT_BYTES = 32
+        private const val PROJECTILE_HITS_PER_READ = 256
+        // seconds a ball flies without hitting anything, as the server keeps them
+        private const val BALL_LIFETIME = 15f
+
+        // exportCharacterStates records: body index, on ground (0 or 1)
+        private const val CHARACTER_STATE_BYTES = 8
+        private const val INITIAL_CHARACTER_CAPACITY = 32
+        // createStaticBatch records: position xyz, size xyz, rotation xyzw
+        private const val STATIC_BOX_BYTES = 40
+        // fewer static boxes than this in a flush get bodies of their own
+        private const val STATIC_BATCH_MIN_BOXES = 8
+
+        // upwards speed of a character box taken as a jump (doPlayerMovement adds it on the ground)
+        private const val CHARACTER_JUMP_THRESHOLD = 1f
+
+        // readContactEvents records: bodyA, bodyB, point xyz, normal xyz, impulse, kind (CONTACT_*)
+        private const val CONTACT_EVENT_BYTES = 40
+        private const val CONTACT_KIND_OFFSET = 36
+        private const val CONTACT_EVENTS_PER_READ = 256
+        const val CONTACT_BEGIN = 0
+        const val CONTACT_PERSIST = 1
+        const val CONTACT_END = 2
+
+        // castRays records
+        const val RAY_BYTES = 28
+        const val HIT_BYTES = 32
+        // queryRegion records: center xyz, size xyz, radius (> 0 for a sphere), mask
+        private const val REGION_QUERY_BYTES = 32
+        private const val INITIAL_REGION_CAPACITY = 64
+
+        // native pools, in getPoolStats order
+        const val POOL_BODIES = 0
+        const val POOL_MOTION_STATES = 1
+        const val POOL_BOX_SHAPES = 2
+        const val POOL_SPHERE_SHAPES = 3
+        const val POOL_SHAPE_ENTRIES = 4
+        const val POOL_CHARACTERS = 5
+        const val POOL_STATIC_BATCHES = 6
+        const val POOL_COUNT = 7
+
+        // phases of stepStats, as timed natively
+        const val PHASE_BROADPHASE = 0
+        const val PHASE_NARROWPHASE = 1
+        const val PHASE_ISLANDS = 2
+        const val PHASE_SOLVER = 3
+        const val PHASE_INTEGRATION = 4
+        const val PHASE_CHARACTERS = 5
+        const val PHASE_TICK = 6 // contact events, projectiles and state hashes after each fixed step
+        const val PHASE_SYNC = 7 // commands and exports
+        const val PHASE_COUNT = 8
+        private val PHASE_NAMES = arrayOf("broad", "narrow", "islands", "solver", "integrate", "chars", "tick", "sync")
+
+        // the rest of stepStats
+        const val STAT_STEP_MILLIS = PHASE_COUNT
+        const val STAT_STEPS = PHASE_COUNT + 1
+        const val STAT_PAIRS = PHASE_COUNT + 2
+        const val STAT_MANIFOLDS = PHASE_COUNT + 3
+        const val STAT_CONTACTS = PHASE_COUNT + 4
+        const val STATS_FLOATS = PHASE_COUNT + 5
+
+        // readFrame info: tick, body slots, projectiles, characters, age in seconds, then stepStats
+        private const val FRAME_STATS_OFFSET = 20
+        private const val FRAME_INFO_BYTES = FRAME_STATS_OFFSET + STATS_FLOATS * 4
+
+        private const val INITIAL_SNAPSHOT_BYTES = 64 * 1024
+        private const val INITIAL_CHECKPOINT_BYTES = 256 * 1024
+
+        // activation states counted in activationCounts
+        const val ACTIVATION_ACTIVE = 0
+        const val ACTIVATION_SLEEPING = 1
+        const val ACTIVATION_WANTS_DEACTIVATION = 2
+        const val ACTIVATION_DISABLE_DEACTIVATION = 3
+        const val ACTIVATION_DISABLE_SIMULATION = 4
+        const val ACTIVATION_STATE_COUNT = 5
+
+        // broadphases: dynamic aabb trees, or sweep and prune within world bounds (16 or 32 bits)
+        const val BROADPHASE_DBVT = 0
+        const val BROADPHASE_SAP = 1
+        const val BROADPHASE_SAP_32 = 2
+        const val BROADPHASE_COUNT = 3
+
+        // constraint solvers, as PHYSICS_SOLVER_* in physics_api.h
+        const val SOLVER_SI = 0
+        const val SOLVER_NNCG = 1
+        const val SOLVER_MLCP_DANTZIG = 2
+        const val SOLVER_MLCP_LEMKE = 3
+        const val SOLVER_MLCP_PGS = 4
+
+        // bounds of the arenas Server.generateWorld makes, with room for balls flying out
+        private val ARENA_MIN = Vector3f(-100f, -50f, -100f)
+        private val ARENA_MAX = Vector3f(100f, 100f, 100f)
 
         private const val TYPE_BOX = 0
         private const val TYPE_CHARACTER = 1
         private const val TYPE_BULLET = 2
+
+        // collision groups, a body only collides with bodies whose group is in its mask
+        const val COLLISION_STATIC = 1
+        const val COLLISION_BOX = 2
+        const val COLLISION_CHARACTER = 4
+        const val COLLISION_BALL = 8
+        const val COLLISION_ALL = -1
     }
 }
\ No newline at end of file
@@ -18,8 +18,10 @@ class ClientStatsUI(
 
     override fun draw(drawer: UIDrawer, screenWidth: Float, screenHeight: Float) {
         if (!visible) return
-        val statCount = 3 // cpu+net fps 60  phys xms   draw xms |  ping 50ms  out 25kb/s  in 25/s   mem used/alloc/Max
-        if (drawer.begin("Stats", 20f, 20f, 300f, statCount*25f,
+        val nativePhysics = physics as? BulletPhysicsNativeImpl
+        val statCount = if (nativePhysics != null) 4 else 3 // cpu+net fps 60  phys xms   draw xms |  ping 50ms  out 25kb/s  in 25/s   mem used/alloc/Max
+        val width = if (nativePhysics != null) 640f else 300f // phases take a long line
+        if (drawer.begin("Stats", 20f, 20f, width, statCount*25f,
                 background = BLACK_TRANSPARENT,
                 flags = drawer.WINDOW_NO_SCROLLBAR)) {
             drawer.layoutRowDynamic(20f, 1)
@@ -27,6 +29,10 @@ class ClientStatsUI(
                 "fps %d  physics %.1fms  draw %.1fms".format(window.fps, physics.lastSimulationMillis, window.lastDrawMillis),
                 drawer.TEXT_LEFT
             )
+            if (nativePhysics != null) {
+                drawer.layoutRowDynamic(20f, 1)
+                drawer.label(nativePhysics.stepStatsSummary(), drawer.TEXT_LEFT)
+            }
             drawer.layoutRowDynamic(20f, 1)
             drawer.label(
                 "lat %dms  in %.1fKB/s  out %.1fKB/s  pps %d"
@@ -28,6 +28,10 @@ class MainActivity : Activity() {
         }
 
         private const val TAG = "snower"
+
+        // Steps physics on a native thread of its own instead of in onDrawFrame, so stepping and
+        // rendering overlap on multi-core devices. Boxes render a frame or so behind.
+        private const val PHYSICS_STEP_THREAD = false
     }
 
     // Major modules
@@ -120,6 +124,7 @@ class MainActivity : Activity() {
             val uiDrawTime = measureTimeMillis { uiRenderer.draw() }
             if (frameReportCounter++ % 10 == 0) {
                 Log.i(TAG, "Physics time: $physicsTime, world draw time: $worldDrawTime, ui draw time: $uiDrawTime")
+                (physics as? BulletPhysicsNativeImpl)?.let { Log.i(TAG, "Physics phases: ${it.stepStatsSummary()}") }
             }
         }
 
@@ -156,13 +161,15 @@ class MainActivity : Activity() {
     override fun onResume() {
         super.onResume()
         println("onResume()")
+        if (PHYSICS_STEP_THREAD) (physics as? BulletPhysicsNativeImpl)?.startStepThread()
         surface!!.onResume()
     }
 
     override fun onPause() {
         super.onPause()
         println("onPause()")
-        surface!!.onPause()
+        surface!!.onPause() // waits for the GL thread, so physics is ours now
+        if (PHYSICS_STEP_THREAD) (physics as? BulletPhysicsNativeImpl)?.stopStepThread()
     }
 
     /** Called when a message from the server arrives. */
@@ -192,6 +199,8 @@ class MainActivity : Activity() {
                     isSphere = msg.isSphere,
                     isCharacter = msg.isCharacter
                 )
+                // so the ball doesn't hit the player that shot it
+                if (msg.ownerId >= 0) box.physicsOwner = boxes[msg.ownerId]
                 addBox(box)
             }
             is Messages.BoxUpdateMotion -> {
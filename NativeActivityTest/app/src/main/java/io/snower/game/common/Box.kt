@@ -58,6 +58,7 @@ class Box(
     var shouldCommitTransformChanges: Boolean = true // always commit on first simulation
     var shouldCommitMomentumChanges: Boolean = true // always commit on first simulation
     var physicsHandle: Any? = null
+    var physicsOwner: Box? = null // never collides with this box (i.e. the player that shot this ball)
 
     // Renderer metadata
     var rendererHandle: Any? = null
@@ -212,11 +212,12 @@ object Messages {
         val bounceMultiplier: Float, // 4
         val color: Color4f, // 4*4
         val isSphere: Boolean, // 1
-        val isCharacter: Boolean // 1
+        val isCharacter: Boolean, // 1
+        val ownerId: Int = -1 // 4, the box of the player that shot it (balls), or -1
     ) {
         companion object : MessageType<BoxAdded> {
             override val bytes: Int
-                get() = 4+(4*3)+(4*3)+(4*3)+(4*3)+(4*4)+4+1+4+8+4+(4*4)+1+1
+                get() = 4+(4*3)+(4*3)+(4*3)+(4*3)+(4*4)+4+1+4+8+4+(4*4)+1+1+4
 
             override fun write(msg: BoxAdded, buf: ByteBuf) {
                 buf.writeInt(msg.id)
@@ -233,6 +234,7 @@ object Messages {
                 buf.writeColor4f(msg.color)
                 buf.writeBoolean(msg.isSphere)
                 buf.writeBoolean(msg.isCharacter)
+                buf.writeInt(msg.ownerId)
             }
 
             override fun read(buf: ByteBuf): BoxAdded {
@@ -250,7 +252,8 @@ object Messages {
                     buf.readFloat(),
                     buf.readColor4f(),
                     buf.readBoolean(),
-                    buf.readBoolean()
+                    buf.readBoolean(),
+                    buf.readInt()
                 )
             }
         }
@@ -20,5 +20,6 @@ interface PhysicsInterface {
     /** Returns how many millis took the last simulation. */
     val lastSimulationMillis: Float
 
-    // TODO: Add collision callbacks
+    /** Set [callback] to be called during [simulate] when two registered boxes start touching. */
+    fun onCollision(callback: (Box, Box) -> Unit)
 }
\ No newline at end of file
@@ -321,9 +321,7 @@ class Server {
                 theColor = Color4f(Math.random().toFloat(), Math.random().toFloat(), Math.random().toFloat(), 1f),
                 isSphere = true
             )
-            addBox(box)
-            bulletsAddTimestamp[box] = System.currentTimeMillis()
-            bulletEmitter[box] = player
+            addBox(box, shooter = player)
             box.applyForce(vectorFront(inputState.cameraY, inputState.cameraX, shotForce))
         }
         if (inputState.fire2 && System.currentTimeMillis() - player.lastShot > 1000) {
@@ -345,9 +343,7 @@ class Server {
                     theColor = Color4f(Math.random().toFloat(), Math.random().toFloat(), Math.random().toFloat(), 1f),
                     isSphere = true
                 )
-                addBox(box)
-                bulletsAddTimestamp[box] = System.currentTimeMillis()
-                bulletEmitter[box] = player
+                addBox(box, shooter = player)
                 box.applyForce(vectorFront(angleXOrientation, inputState.cameraX, shotForce))
             }
         }
@@ -368,14 +364,23 @@ class Server {
             bounceMultiplier = box.bounceMultiplier,
             color = box.theColor,
             isSphere = box.isSphere,
-            isCharacter = box.isCharacter
+            isCharacter = box.isCharacter,
+            ownerId = bulletEmitter[box]?.collisionBox?.id ?: -1
         )
     }
 
-    private fun addBox(box: Box) {
+    /** Adds [box] and streams it to everyone. Balls need their [shooter], which clients don't hit. */
+    private fun addBox(box: Box, shooter: Player? = null) {
+        if (shooter != null) {
+            // before the message is built, as it carries the shooter
+            bulletsAddTimestamp[box] = System.currentTimeMillis()
+            bulletEmitter[box] = shooter
+        }
         physics.register(box)
         boxes.add(box)
-        network.broadcast(buildStreamBoxMsg(box))
+        val msg = buildStreamBoxMsg(box)
+        check(!box.isSphere || msg.ownerId == shooter?.collisionBox?.id) { "ball ${box.id} streamed without its shooter" }
+        network.broadcast(msg)
     }
 
     private fun removeBox(box: Box) {